@@ -1,8 +1,17 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include <crypt.h>
 #include <time.h>
+#include <unistd.h>
+#include "sha512crypt.h"
+#include "sha512mb.h"
+#include "targets.h"
+#include "mask.h"
+#include "scheme.h"
+#include "batch.h"
+#include "table.h"
+#include "log.h"
+#include "meter.h"
 
 /******************************************************************************
   Demonstrates how to crack an encrypted password using a simple
@@ -11,19 +20,58 @@
   code. 
 
   Compile with:
-    cc -o CrackAZ99-With-Data CrackAZ99-With-Data.c -lcrypt
+    cc -O2 -o CrackAZ99-With-Data CrackAZ99-With-Data.c sha512crypt.c \
+       sha512mb.c targets.c mask.c scheme.c table.c log.c meter.c batch.c \
+       -pthread -lcrypt -lm
 
   If you want to analyse the results then use the redirection operator to send
   output to a file that you can view using an editor or the less utility:
 
     ./CrackAZ99-With-Data > results.txt
 
+  Only the passwords that are found and a summary are displayed. -v adds a
+  line per salt and -vv a line for every combination that is tried, which
+  slows the search down a great deal; -q leaves only the passwords. Output
+  goes through a writer thread, see log.h, which drops -v and -vv lines
+  rather than fall behind.
+
+  Every 10 seconds, or every -i seconds, the hash rate, the share of the
+  sweeps that is done and the time left are displayed; -i 0 turns this off.
+  -j file writes the totals to file as JSON at the end, in the same form as
+  Threadcw and babupw. See meter.h.
+
+  Candidates are hashed several at a time in SIMD lanes. The widest engine the
+  CPU supports is used unless one is picked with -e scalar, -e avx2 or
+  -e avx512.
+
+  With -m every target is cracked in the same sweep: the keyspace is hashed
+  once per distinct salt rather than once per hash, and only the passwords
+  that are found are displayed. A salt is dropped as soon as all of its
+  targets have been found, and the run ends once every target has been.
+
+  -f file cracks the hashes in file, one per line or in the format of
+  /etc/shadow, instead of the ones below. It implies -m. With -m the hashes
+  can also be MD5-crypt ($1$), SHA-256-crypt ($5$) or bcrypt ($2b$) ones.
+
+  -T file looks the targets up in a table made by PrecomputeTable, which is
+  a binary search rather than a sweep of the keyspace. It implies -m. Only
+  targets with the table's setting are looked up, and only when the mask is
+  the one the table was made for; the rest are searched for as usual.
+
+  -M changes the shape of the passwords that are tried, e.g. -M '?u?u?u?d?d'
+  for 3 letters and 2 digits. -1 to -4 give the charsets for ?1 to ?4 in the
+  mask, e.g. -1 AEIOU -M '?1?u?d?d'. See mask.h for the full mask language.
+
   Dr Kevan Buckley, University of Wolverhampton, 2018
 ******************************************************************************/
 int n_passwords = 4;
+int engine;        // Which SHA-512-crypt kernel to hash with
+mask keyspace;     // The shape of the passwords being tried
+uint64_t keyspace_size; // How many passwords that is
+meter metrics;     // Candidates hashed and swept, for the progress reports
 
 char *encrypted_passwords[] = {
-  "$6$KB$3MiAO5oLs/.coZCPQ2QYOy8Ozo3v7QzGdwBEv3N7E0pJen3CJ63DmYXIZz6KEsykHmGsu3Dh1KCNe0niN0wvx/,
+  "$6$KB$3MiAO5oLs/.coZCPQ2QYOy8Ozo3v7QzGdwBEv3N7E0pJen3CJ63DmYXIZz6KEsykHmGsu3Dh1KCNe0niN0wvx/",
   "$6$KB$7rLS8BU8lh76q9iZ3Ogb8w1G45hmJUMoHdmOyHuQFUBqyr7XnEMUEs2wF4xGJRgQob7nC/RD9e1AKQZr/CKI30",
   "$6$KB$L4mWcpv6rMAbZdxfSsuAL2UZhbJ4vSGAAxk.vEcRKvIuPpwcSRKHzi3BXzWQWaH1p1ubwaFl.06CRQv6bVo3M1",
   "$6$KB$jM4o2O3EJI9OCoHvf8Jo0YG4JcnwEPFqpJINXb4RGEahSL5JRIQt1s2djLbGHThVv9IGzrYsS18XICkn5074./"
@@ -39,37 +87,83 @@ void substr(char *dest, char *src, int start, int length){
 }
 
 /**
- This function can crack the kind of password explained above. All combinations
- that are tried are displayed and when the password is found, #, is put at the 
- start of the line. Note that one of the most time consuming operations that 
- it performs is the output of intermediate results, so performance experiments 
- for this kind of program should not include this. i.e. comment out the printfs.
+ Hashes the n candidates waiting in plain together and reports each of them.
+ The digests are compared with the target's, which was decoded beforehand,
+ so nothing is base64 encoded here. Returns 1 if one of them is the password.
+*/
+
+int check_batch(sha512crypt_salt *salt, char *salt_and_encrypted,
+                const unsigned char *target, char (*plain)[MASK_MAX + 1],
+                int n, uint64_t *count){
+  const char *keys[SHA512MB_LANES_MAX] = {0};
+  unsigned char digest[SHA512MB_LANES_MAX][SHA512CRYPT_DIGEST_LEN];
+  int i, found = 0;
+
+  for(i=0; i<n; i++){
+    keys[i] = plain[i];
+  }
+  sha512crypt_mb(engine, salt, keys, keyspace.length, n, digest);
+  meter_hashed(&metrics.slots[0], n);
+  meter_done(&metrics.slots[0], n);
+
+  for(i=0; i<n; i++){
+    (*count)++;
+    if(sha512crypt_equal(digest[i], target)){
+      log_printf(LOG_RESULT, "#%-8llu%s %s", (unsigned long long) *count,
+                 plain[i], salt_and_encrypted);
+      found = 1;
+    } else {
+      log_printf(LOG_ATTEMPT, " %-8llu%s", (unsigned long long) *count,
+                 plain[i]);
+    }
+  }
+  return found;
+}
+
+/**
+ This function can crack the kind of password explained above. With -vv the
+ combinations that are tried are displayed as well, as far as the output can
+ keep up: when it falls behind, those lines are dropped and counted rather
+ than slow the search, see log.h. When the password is found, #, is put at
+ the start of the line, and that line is never dropped. Performance
+ experiments for this kind of program should still not use -vv.
+ The search stops once the password has been found.
 */
 
 void crack(char *salt_and_encrypted){
-  int x, y, z;     // Loop counters
-  char salt[7];    // String used in hashing the password. Need space for \0
-  char plain[7];   // The combination of letters currently being checked
-  char *enc;       // Pointer to the encrypted password
-  int count = 0;   // The number of combinations explored so far
-
-  substr(salt, salt_and_encrypted, 0, 6);
-
-  for(x='A'; x<='Z'; x++){
-    for(y='A'; y<='Z'; y++){
-      for(z=0; z<=99; z++){
-        sprintf(plain, "%c%c%02d", x, y, z); 
-        enc = (char *) crypt(plain, salt);
-        count++;
-        if(strcmp(salt_and_encrypted, enc) == 0){
-          printf("#%-8d%s %s\n", count, plain, enc);
-        } else {
-          printf(" %-8d%s %s\n", count, plain, enc);
-        }
-      }
+  mask_iter it;    // Walks through the combinations
+  sha512crypt_salt salt; // Salt state, worked out once for this target
+  unsigned char target[SHA512CRYPT_DIGEST_LEN]; // The digest being looked for
+  char plain[SHA512MB_LANES_MAX][MASK_MAX + 1]; // Waiting to be hashed
+  int n = 0;       // How many of plain are filled in
+  int lanes = sha512mb_lanes(engine);
+  uint64_t count = 0; // The number of combinations explored so far
+  int found = 0;
+  int len = sha512crypt_setting_len(salt_and_encrypted);
+
+  if(len < 0 || sha512crypt_parse_salt(&salt, salt_and_encrypted) != 0 ||
+     sha512crypt_decode(salt_and_encrypted + len,
+                        strlen(salt_and_encrypted + len), target) != 0){
+    log_printf(LOG_INFO, "%s is not a SHA-512-crypt hash", salt_and_encrypted);
+    meter_done(&metrics.slots[0], keyspace_size);
+    return;
+  }
+
+  mask_seek(&it, &keyspace, 0);
+  do {
+    memcpy(plain[n++], it.plain, keyspace.length + 1);
+    if(n == lanes){
+      found = check_batch(&salt, salt_and_encrypted, target, plain, n,
+                          &count);
+      n = 0;
     }
+  } while(!found && mask_next(&it));
+  if(n > 0){
+    check_batch(&salt, salt_and_encrypted, target, plain, n, &count);
   }
-  printf("%d solutions explored\n", count);
+  meter_chunk(&metrics.slots[0], keyspace_size - count);
+  log_printf(LOG_INFO, "%llu solutions explored",
+             (unsigned long long) count);
 }
 
 int time_difference(struct timespec *start, struct timespec *finish, 
@@ -85,18 +179,211 @@ int time_difference(struct timespec *start, struct timespec *finish,
   return !(*difference > 0);
 }
 
-int main(){
-  int i;
+/**
+ Hashes a block of candidates with the salt of one group of targets and
+ reports any of them that match a target in that group.
+*/
+
+void check_group(target_set *set, int group, scheme_ctx *scheme,
+                 const candidate_batch *b){
+  unsigned char digest[BATCH_SIZE][SHA512CRYPT_DIGEST_LEN];
+  int found[BATCH_SIZE];
+  int i, t;
+
+  batch_hash(b, scheme, engine, digest);
+  meter_hashed(&metrics.slots[0], b->n);
+  meter_done(&metrics.slots[0], b->n);
+  if(batch_match(b, set, group, digest, found) == 0){
+    return;
+  }
+
+  for(i=0; i<b->n; i++){
+    for(t=found[i]; t>=0; t=set->targets[t].next){
+      if(targets_crack(set, t, b->index[i])){
+        log_printf(LOG_RESULT, "#%-8llu%s %.*s",
+                   (unsigned long long) (b->index[i] + 1), b->plain[i],
+                   set->targets[t].hash_len, set->targets[t].hash);
+      }
+    }
+  }
+}
+
+/**
+ Cracks all of the targets with one sweep of the keyspace per distinct salt,
+ which ends early once every target with that salt has been found. Groups
+ marked in covered, if it is not NULL, were looked up in a table of the whole
+ keyspace, so there is nothing left to find in them.
+*/
+
+void crack_all(target_set *set, const char *covered){
+  int g;           // Group counter
+  mask_range range;
+  scheme_ctx scheme;
+  candidate_batch b;
+  uint64_t count;
+
+  scheme_ctx_init(&scheme);
+  for(g=0; g<set->n_groups; g++){
+    if(group_remaining(set, g) == 0 || (covered && covered[g])){
+      meter_done(&metrics.slots[0], keyspace_size);
+      continue;
+    }
+    scheme_ctx_set(&scheme, set->groups[g].setting);
+    count = 0;
+    mask_range_init(&range, &keyspace, 0, keyspace_size);
+    while(group_remaining(set, g) > 0 && batch_fill_mask(&b, &range)){
+      check_group(set, g, &scheme, &b);
+      count += b.n;
+    }
+    meter_chunk(&metrics.slots[0], keyspace_size - count);
+    log_printf(LOG_PROGRESS, "%llu solutions explored for %d targets with "
+               "salt %s", (unsigned long long) count, set->groups[g].n_targets,
+               set->groups[g].setting);
+  }
+  scheme_ctx_free(&scheme);
+}
+
+/**
+ Cracks the targets that a precomputed table covers, leaving crack_all() to
+ search for any others. Returns which groups the table covered, or NULL if
+ it could not be opened.
+*/
+
+char *lookup_all(target_set *set, const char *path){
+  digest_table table;
+  char *covered;
+  scheme_ctx scheme;
+  char plain[MASK_MAX + 1];
+  uint64_t index;
+  int i, looked_up = 0;
+
+  if(table_open(&table, path) != 0){
+    return NULL;
+  }
+  covered = calloc(set->n_groups > 0 ? set->n_groups : 1, 1);
+  scheme_ctx_init(&scheme);
+  for(i=0; i<set->n_targets; i++){
+    target *t = &set->targets[i];
+    const char *setting = set->groups[t->group].setting;
+
+    if(!table_covers(&table, setting, &keyspace)){
+      continue;
+    }
+    scheme_ctx_set(&scheme, setting);
+    covered[t->group] = 1;
+    looked_up++;
+    if(table_lookup(&table, &keyspace, &scheme, engine, t->digest, &index,
+                    plain) && targets_crack(set, i, index)){
+      log_printf(LOG_RESULT, "#%-8llu%s %.*s",
+                 (unsigned long long) (index + 1), plain, t->hash_len,
+                 t->hash);
+    }
+  }
+  log_printf(LOG_INFO, "%d targets looked up in %s", looked_up, path);
+  scheme_ctx_free(&scheme);
+  table_close(&table);
+  return covered;
+}
+
+int main(int argc, char *argv[]){
+  int i, opt;
    struct timespec start, finish;   
   long long int time_elapsed;
+  char *engine_name = "auto";
+  int multi = 0;   // Crack every target in one sweep per salt
+  char *hash_file = NULL;
+  char *table_file = NULL;
+  char *covered = NULL; // Groups that the table has dealt with
+  char *report_file = NULL;
+  int report_interval = 10;
+  int one = 1;
+  meter_count counts;
+  target_set set;
+  char *mask_text = "?u?u?d?d";
+  char *custom[MASK_CUSTOM] = {0};
+
+  while((opt = getopt(argc, argv, "e:mf:T:M:1:2:3:4:i:j:vq")) != -1){
+    if(opt == 'e'){
+      engine_name = optarg;
+    } else if(opt == 'm'){
+      multi = 1;
+    } else if(opt == 'f'){
+      hash_file = optarg;
+      multi = 1;
+    } else if(opt == 'T'){
+      table_file = optarg;
+      multi = 1;
+    } else if(opt == 'M'){
+      mask_text = optarg;
+    } else if(opt >= '1' && opt < '1' + MASK_CUSTOM){
+      custom[opt - '1'] = optarg;
+    } else if(opt == 'i'){
+      report_interval = atoi(optarg);
+    } else if(opt == 'j'){
+      report_file = optarg;
+    } else if(opt == 'v'){
+      log_verbosity++;
+    } else if(opt == 'q'){
+      log_verbosity--;
+    } else {
+      fprintf(stderr, "Usage: %s [-e auto|scalar|avx2|avx512] [-m] "
+              "[-f hash_file] [-T table] [-M mask] [-1 charset] ... "
+              "[-4 charset] [-i seconds] [-j report] [-v | -q]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  if(mask_parse(&keyspace, mask_text, custom) != 0){
+    return 1;
+  }
+  keyspace_size = mask_keyspace(&keyspace);
+  engine = sha512mb_select(engine_name);
+  if(engine < 0){
+    fprintf(stderr, "Engine %s is not available on this CPU\n", engine_name);
+    return 1;
+  }
+  log_open(stdout);
+  log_printf(LOG_INFO, "Hashing with the %s engine, %d lanes",
+             sha512mb_name(engine), sha512mb_lanes(engine));
 
   clock_gettime(CLOCK_MONOTONIC, &start);
   
-  for(i=0;i<n_passwords;i<i++) {
-    crack(encrypted_passwords[i]);
+  if(multi){
+    if(hash_file){
+      if(targets_load_file(&set, hash_file) < 0){
+        log_close();
+        return 1;
+      }
+    } else {
+      targets_load(&set, encrypted_passwords, n_passwords);
+    }
+    meter_init(&metrics, 1, keyspace_size * set.n_groups);
+    meter_start(&metrics, report_interval);
+    if(table_file){
+      covered = lookup_all(&set, table_file);
+    }
+    crack_all(&set, covered);
+    meter_stop(&metrics);
+    free(covered);
+    targets_summary(&set);
+    targets_free(&set);
+  } else {
+    meter_init(&metrics, 1, keyspace_size * n_passwords);
+    meter_start(&metrics, report_interval);
+    for(i=0;i<n_passwords;i<i++) {
+      crack(encrypted_passwords[i]);
+    }
+    meter_stop(&metrics);
   }
   
   clock_gettime(CLOCK_MONOTONIC, &finish);
+  if(report_file){
+    meter_counts(&metrics, 0, 1, &counts);
+    meter_json(report_file, "CrackAZ99-With-Data", NULL,
+               meter_seconds(&metrics), 1, &one, &counts);
+  }
+  meter_free(&metrics);
+  log_close();
   time_difference(&start, &finish, &time_elapsed);
   printf("Time elapsed was %lldns or %0.9lfs\n", time_elapsed, 
          (time_elapsed/1.0e9)); 
@@ -1,8 +1,11 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include <crypt.h>
 #include <time.h>
+#include <unistd.h>
+#include "sha512crypt.h"
+#include "mask.h"
+#include "log.h"
 
 /******************************************************************************
   Demonstrates how to crack an encrypted password using a simple
@@ -11,13 +14,18 @@
   code. 
 
   Compile with:
-    cc -o CrackAZ99-With-Data110 CrackAZ99-With-Data110.c -lcrypt
+    cc -O2 -o CrackAZ99-With-Data110 CrackAZ99-With-Data110.c sha512crypt.c \
+       mask.c log.c -pthread
 
   If you want to analyse the results then use the redirection operator to send
   output to a file that you can view using an editor or the less utility:
 
     ./CrackAZ99-With-Data110 > CrackAZ99-With-Data110_results.txt
 
+  Only the passwords that are found and a summary are displayed unless -vv
+  is given, which displays the combinations that are tried as far as the
+  output can keep up, see log.h; -q leaves only the passwords.
+
   Dr Kevan Buckley, University of Wolverhampton, 2018
 ******************************************************************************/
 int n_passwords = 4;
@@ -39,39 +47,47 @@ void substr(char *dest, char *src, int start, int length){
 }
 
 /**
- This function can crack the kind of password explained above. All combinations
- that are tried are displayed and when the password is found, #, is put at the 
- start of the line. Note that one of the most time consuming operations that 
- it performs is the output of intermediate results, so performance experiments 
- for this kind of program should not include this. i.e. comment out the printfs.
+ This function can crack the kind of password explained above. With -vv the
+ combinations that are tried are displayed as well, as far as the output can
+ keep up: when it falls behind, those lines are dropped and counted rather
+ than slow the search, see log.h. When the password is found, #, is put at
+ the start of the line, and that line is never dropped. Performance
+ experiments for this kind of program should still not use -vv.
+ The search stops once the password has been found.
 */
 
 void crack(char *salt_and_encrypted){
-  int a, b, c, d;     // Loop counters
-  char aalt[7];    // String used in hashing the password. Need space for \0
-  char plain[7];   // The combination of letters currently being checked
-  char *enc;       // Pointer to the encrypted password
+  mask keyspace;   // 3 uppercase letters and a 2 digit integer
+  mask_iter it;    // Walks through the combinations
+  sha512crypt_salt salt; // Salt state, worked out once for this target
+  unsigned char digest[SHA512CRYPT_DIGEST_LEN];
+  unsigned char target[SHA512CRYPT_DIGEST_LEN]; // The digest being looked for
   int count = 0;   // The number of combinations explored so far
-
-  substr(salt, salt_and_encrypted, 0, 6);
-
-  for(a='A'; a<='Z'; a++){
-    for(b='A'; b<='Z'; b++){
-    for(c='A'; c<='Z'; c++){
-      for(d=0; d<=99; d++){
-        sprintf(plain, "%c%c%c%02d", a, b, c, d); 
-        enc = (char *) crypt(plain, salt);
-        count++;
-        if(strcmp(salt_and_encrypted, enc) == 0){
-          printf("#%-8d%s %s\n", count, plain, enc);
-        } else {
-          printf(" %-8d%s %s\n", count, plain, enc);
-        }
-      }
-    }
-   }
+  int found = 0;
+  int len = sha512crypt_setting_len(salt_and_encrypted);
+
+  // Decoded once, so candidates are compared as binary with no base64
+  if(len < 0 || sha512crypt_parse_salt(&salt, salt_and_encrypted) != 0 ||
+     sha512crypt_decode(salt_and_encrypted + len,
+                        strlen(salt_and_encrypted + len), target) != 0){
+    log_printf(LOG_INFO, "%s is not a SHA-512-crypt hash", salt_and_encrypted);
+    return;
   }
-  printf("%d solutions explored\n", count);
+  mask_parse(&keyspace, "?u?u?u?d?d", NULL);
+
+  mask_seek(&it, &keyspace, 0);
+  do {
+    sha512crypt_raw(&salt, it.plain, keyspace.length, digest);
+    count++;
+    if(sha512crypt_equal(digest, target)){
+      log_printf(LOG_RESULT, "#%-8d%s %s", count, it.plain,
+                 salt_and_encrypted);
+      found = 1;
+    } else {
+      log_printf(LOG_ATTEMPT, " %-8d%s", count, it.plain);
+    }
+  } while(!found && mask_next(&it));
+  log_printf(LOG_INFO, "%d solutions explored", count);
 }
 int time_difference(struct timespec *start, struct timespec *finish, 
                               long long int *difference) {
@@ -87,10 +103,22 @@ int time_difference(struct timespec *start, struct timespec *finish,
 }
 
 int main(int argc, char *argv[]){
-  int i;
+  int i, opt;
 struct timespec start, finish;   
   long long int time_elapsed;
 
+  while((opt = getopt(argc, argv, "vq")) != -1){
+    if(opt == 'v'){
+      log_verbosity++;
+    } else if(opt == 'q'){
+      log_verbosity--;
+    } else {
+      fprintf(stderr, "Usage: %s [-v | -q]\n", argv[0]);
+      return 1;
+    }
+  }
+  log_open(stdout);
+
   clock_gettime(CLOCK_MONOTONIC, &start);
  
   
@@ -99,6 +127,7 @@ struct timespec start, finish;
   }
 
   clock_gettime(CLOCK_MONOTONIC, &finish);
+  log_close();
   time_difference(&start, &finish, &time_elapsed);
   printf("Time elapsed was %lldns or %0.9lfs\n", time_elapsed, 
          (time_elapsed/1.0e9)); 
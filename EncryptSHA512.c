@@ -1,28 +1,325 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include <crypt.h>
+#include <sys/random.h>
+#include "pool.h"
 
 /******************************************************************************
-  This program is used to set challenges for password cracking programs. 
+  This program is used to set challenges for password cracking programs.
   Encrypts using SHA-512.
-  
+
   Compile with:
-    cc -o EncryptSHA512 EncryptSHA512.c -lcrypt
-    
+    cc -O2 -o EncryptSHA512 EncryptSHA512.c pool.c -pthread -lcrypt
+
   To encrypt the password "pass":
     ./EncryptSHA512 pass
-    
+
   It doesn't do any checking, just does the job or fails ungracefully.
 
+  Without a password it reads passwords one per line, from the file given
+  with -i or from standard input, and writes one hash per line in the same
+  order, to the file given with -o or to standard output. Passwords are
+  hashed on a pool of threads, -t of them (one per online CPU by default),
+  so a corpus of millions of hashes is one run:
+
+    ./EncryptSHA512 -R -i words.txt -o hashes.txt
+
+  -R gives every password a random 16 character salt from getrandom()
+  instead of KB, -s changes the fixed salt, -r N hashes with N rounds
+  instead of the default 5000, and -p writes hash:password lines.
+
   Dr Kevan Buckley, University of Wolverhampton, 2017
 ******************************************************************************/
 
-#define SALT "$6$KB$"
+#define SALT_LEN     16         // Characters in a random salt
+#define BATCH_LINES  65536      // Passwords read in before they are hashed
+#define BLOCK_LINES  256        // Passwords per work item
+#define BUFFER_SIZE  (16 << 20) // Bytes of input held at once
+#define OUTPUT_SIZE  (1 << 20)  // Bytes of output buffered before writing
 
-int main(int argc, char *argv[]){
-  
-  printf("%s\n", crypt(argv[1], SALT));
+static const char salt_chars[] =
+  "./0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+
+char prefix[32] = "$6$";  // The setting up to the salt
+char *salt = "KB";        // The fixed salt, when it is not random
+int random_salts = 0;
+int print_plain = 0;
+
+typedef struct {
+  const char *text;       // Terminated in place in the input buffer
+  size_t len;
+} password;
+
+password *passwords;      // The batch being hashed
+int n_passwords;
+char **outputs;           // What each block of the batch writes out
+size_t *output_len;
+struct crypt_data *data;  // One for each thread
+
+/**
+ Fills buf with random bytes. getrandom() can return fewer than asked for
+ when interrupted, so it is called until it has them all.
+*/
+
+void fill_random(unsigned char *buf, size_t len){
+  while(len > 0){
+    ssize_t n = getrandom(buf, len, 0);
+    if(n < 0){
+      perror("getrandom");
+      exit(1);
+    }
+    buf += n;
+    len -= n;
+  }
+}
+
+/**
+ Writes the setting for one password: the prefix, the fixed salt or
+ SALT_LEN random characters, and the closing $.
+*/
+
+void make_setting(char *setting, const unsigned char *random){
+  size_t len = strlen(prefix);
+  int i;
+
+  memcpy(setting, prefix, len);
+  if(random_salts){
+    for(i=0; i<SALT_LEN; i++){
+      setting[len++] = salt_chars[random[i] & 63];
+    }
+  } else {
+    strcpy(setting + len, salt);
+    len += strlen(salt);
+  }
+  strcpy(setting + len, "$");
+}
+
+/**
+ Hashes one block of BLOCK_LINES passwords into the block's own output
+ buffer, so that the blocks can be written out in order afterwards.
+*/
+
+int hash_block(void *arg, int worker, uint32_t item){
+  int first = item * BLOCK_LINES;
+  int last = n_passwords - first > BLOCK_LINES ? first + BLOCK_LINES :
+                                                 n_passwords;
+  unsigned char random[BLOCK_LINES * SALT_LEN];
+  char setting[CRYPT_OUTPUT_SIZE];
+  size_t size = 0, len = 0;
+  char *out;
+  int i;
+
+  for(i=first; i<last; i++){
+    size += CRYPT_OUTPUT_SIZE + 2 + (print_plain ? passwords[i].len : 0);
+  }
+  out = outputs[item] = malloc(size);
+  if(random_salts){
+    fill_random(random, (last - first) * SALT_LEN);
+  }
+
+  for(i=first; i<last; i++){
+    const char *hash;
+    size_t hash_len;
 
+    make_setting(setting, random + (i - first) * SALT_LEN);
+    hash = crypt_rn(passwords[i].text, setting, &data[worker],
+                    sizeof(struct crypt_data));
+    if(hash == NULL || hash[0] == '*'){
+      fprintf(stderr, "Cannot hash with setting %s\n", setting);
+      exit(1);
+    }
+    hash_len = strlen(hash);
+    memcpy(out + len, hash, hash_len);
+    len += hash_len;
+    if(print_plain){
+      out[len++] = ':';
+      memcpy(out + len, passwords[i].text, passwords[i].len);
+      len += passwords[i].len;
+    }
+    out[len++] = '\n';
+  }
+  output_len[item] = len;
   return 0;
 }
+
+/**
+ Splits the next batch of passwords out of the input, reading more of it
+ into buf as needed. Lines are terminated where they lie, so nothing is
+ copied. Returns the number of passwords, 0 at the end of the input.
+*/
+
+int read_batch(FILE *in, char *buf){
+  static size_t have = 0, used = 0;
+  static int eof = 0;
+  int n = 0;
+
+  while(n < BATCH_LINES){
+    char *p = buf + used;
+    char *nl = memchr(p, '\n', have - used);
+    char *end = nl;
+
+    if(nl == NULL){
+      if(eof){
+        if(used < have){
+          // The last line has no newline
+          end = buf + have;
+          used = have;
+        } else {
+          break;
+        }
+      } else if(n > 0){
+        // Hash what there is before the buffer is moved under it
+        break;
+      } else {
+        size_t r;
+
+        memmove(buf, buf + used, have - used);
+        have -= used;
+        used = 0;
+        if(have == BUFFER_SIZE){
+          fprintf(stderr, "A line is longer than %d bytes\n", BUFFER_SIZE);
+          exit(1);
+        }
+        r = fread(buf + have, 1, BUFFER_SIZE - have, in);
+        if(r == 0){
+          if(ferror(in)){
+            perror("read");
+            exit(1);
+          }
+          eof = 1;
+        }
+        have += r;
+        continue;
+      }
+    } else {
+      used = nl + 1 - buf;
+    }
+    if(end > p && end[-1] == '\r'){
+      end--;
+    }
+    *end = '\0';
+    passwords[n].text = p;
+    passwords[n].len = end - p;
+    n++;
+  }
+  return n;
+}
+
+/**
+ Hashes every password in the input, a batch at a time.
+*/
+
+int encrypt_all(FILE *in, FILE *out, int n_threads){
+  char *buf = malloc(BUFFER_SIZE + 1);  // + 1 for a terminator at the end
+  int n_blocks = (BATCH_LINES + BLOCK_LINES - 1) / BLOCK_LINES;
+  long long total = 0;
+  int i;
+
+  passwords = malloc(BATCH_LINES * sizeof(password));
+  outputs = malloc(n_blocks * sizeof(char *));
+  output_len = malloc(n_blocks * sizeof(size_t));
+  data = calloc(n_threads, sizeof(struct crypt_data));
+  setvbuf(out, NULL, _IOFBF, OUTPUT_SIZE);
+
+  while((n_passwords = read_batch(in, buf)) > 0){
+    n_blocks = (n_passwords + BLOCK_LINES - 1) / BLOCK_LINES;
+    pool_run(n_threads, n_blocks, hash_block, NULL);
+    for(i=0; i<n_blocks; i++){
+      fwrite(outputs[i], 1, output_len[i], out);
+      free(outputs[i]);
+    }
+    total += n_passwords;
+  }
+  if(fflush(out) != 0){
+    perror("write");
+    return 1;
+  }
+  fprintf(stderr, "%lld passwords hashed\n", total);
+
+  free(buf);
+  free(passwords);
+  free(outputs);
+  free(output_len);
+  free(data);
+  return 0;
+}
+
+int main(int argc, char *argv[]){
+  int opt, status;
+  int n_threads = pool_default_workers();
+  char *input = NULL, *output = NULL;
+  FILE *in = stdin, *out = stdout;
+  unsigned long rounds = 0;
+  char setting[CRYPT_OUTPUT_SIZE];
+  struct crypt_data single;
+  char *end, *hash;
+
+  while((opt = getopt(argc, argv, "i:o:t:r:s:Rp")) != -1){
+    if(opt == 'i'){
+      input = optarg;
+    } else if(opt == 'o'){
+      output = optarg;
+    } else if(opt == 't'){
+      n_threads = atoi(optarg) > 0 ? atoi(optarg) : 1;
+    } else if(opt == 'r'){
+      rounds = strtoul(optarg, &end, 10);
+      if(end == optarg || *end != '\0' || rounds == 0){
+        fprintf(stderr, "%s is not a number of rounds\n", optarg);
+        return 1;
+      }
+    } else if(opt == 's'){
+      salt = optarg;
+    } else if(opt == 'R'){
+      random_salts = 1;
+    } else if(opt == 'p'){
+      print_plain = 1;
+    } else {
+      fprintf(stderr, "Usage: %s [-r rounds] [-s salt | -R] password\n"
+              "       %s [-r rounds] [-s salt | -R] [-p] [-t threads] "
+              "[-i input] [-o output]\n", argv[0], argv[0]);
+      return 1;
+    }
+  }
+  if(rounds > 0){
+    snprintf(prefix, sizeof(prefix), "$6$rounds=%lu$", rounds);
+  }
+  if(strlen(salt) > SALT_LEN || strchr(salt, '$') != NULL){
+    fprintf(stderr, "A salt is at most %d characters and has no $\n",
+            SALT_LEN);
+    return 1;
+  }
+
+  if(optind < argc){
+    unsigned char random[SALT_LEN];
+
+    if(random_salts){
+      fill_random(random, SALT_LEN);
+    }
+    make_setting(setting, random);
+    memset(&single, 0, sizeof(single));
+    hash = crypt_rn(argv[optind], setting, &single, sizeof(single));
+    if(hash == NULL || hash[0] == '*'){
+      fprintf(stderr, "Cannot hash with setting %s\n", setting);
+      return 1;
+    }
+    printf("%s\n", hash);
+    return 0;
+  }
+
+  if(input && (in = fopen(input, "rb")) == NULL){
+    perror(input);
+    return 1;
+  }
+  if(output && (out = fopen(output, "wb")) == NULL){
+    perror(output);
+    return 1;
+  }
+  status = encrypt_all(in, out, n_threads);
+  if(output && fclose(out) != 0){
+    perror(output);
+    status = 1;
+  }
+  return status;
+}
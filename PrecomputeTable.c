@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "sha512crypt.h"
+#include "sha512mb.h"
+#include "pool.h"
+#include "mask.h"
+#include "scheme.h"
+#include "table.h"
+
+/******************************************************************************
+  Hashes every candidate in a mask with one setting and writes the digests
+  out as a sorted table, so that cracking any hash with that setting is a
+  lookup instead of a search. CrackAZ99-With-Data uses a table given with -T
+  for the targets it covers and searches for the rest as usual.
+
+  Compile with:
+    cc -O2 -o PrecomputeTable PrecomputeTable.c sha512crypt.c sha512mb.c \
+       pool.c mask.c scheme.c table.c -pthread -lcrypt -lm
+
+  To make a table of the 2 letter, 2 digit passwords with the course salt:
+    ./PrecomputeTable KB-AZ99.tbl
+
+  -S picks the setting, $6$KB$ by default, which can be any scheme that
+  scheme.h knows. -M and -1 to -4 give the mask as in CrackAZ99-With-Data, -e
+  the SHA-512-crypt kernel and -t the thread count. A table takes 16 bytes
+  per candidate.
+******************************************************************************/
+
+#define CHUNK    200    // Candidates per work item, a multiple of 8 lanes
+
+mask keyspace;
+uint64_t keyspace_size;
+const char *setting = "$6$KB$";
+int engine;
+table_entry *entries;   // One per candidate, in candidate order until sorted
+
+/**
+ Hashes one chunk of the keyspace. Each thread has a context of its own,
+ kept from one chunk to the next.
+*/
+
+int kernel_function(void *arg, int worker, uint32_t item){
+  scheme_ctx *scheme = (scheme_ctx *) arg + worker;
+  uint64_t first = (uint64_t) item * CHUNK;
+  uint64_t last = keyspace_size - first > CHUNK ? first + CHUNK :
+                                                  keyspace_size;
+  int lanes = sha512mb_lanes(engine);
+  mask_range range;
+  char plain[SHA512MB_LANES_MAX][MASK_MAX + 1];
+  const char *keys[SHA512MB_LANES_MAX];
+  unsigned char digest[SHA512MB_LANES_MAX][SHA512CRYPT_DIGEST_LEN];
+  uint64_t index[SHA512MB_LANES_MAX];
+  int n, i;
+
+  scheme_ctx_set(scheme, setting);
+  mask_range_init(&range, &keyspace, first, last);
+  while(range.index < range.end){
+    for(n=0; n<lanes && mask_range_next(&range, plain[n], &index[n]); n++){
+      keys[n] = plain[n];
+    }
+    scheme_hash(scheme, engine, keys, keyspace.length, n, digest);
+    for(i=0; i<n; i++){
+      entries[index[i]].prefix = table_prefix(digest[i]);
+      entries[index[i]].index = index[i];
+    }
+  }
+  return 0;
+}
+
+int time_difference(struct timespec *start, struct timespec *finish,
+                    long long int *difference) {
+  long long int ds =  finish->tv_sec - start->tv_sec;
+  long long int dn =  finish->tv_nsec - start->tv_nsec;
+
+  if(dn < 0 ) {
+    ds--;
+    dn += 1000000000;
+  }
+  *difference = ds * 1000000000 + dn;
+  return !(*difference > 0);
+}
+
+int main(int argc, char *argv[]){
+  int i, opt;
+  int n_threads = pool_default_workers();
+  char *engine_name = "auto";
+  char *mask_text = "?u?u?d?d";
+  char *custom[MASK_CUSTOM] = {0};
+  scheme_ctx *contexts;
+  struct timespec start, finish;
+  long long int time_elapsed;
+  int status;
+
+  while((opt = getopt(argc, argv, "e:t:S:M:1:2:3:4:")) != -1){
+    if(opt == 'e'){
+      engine_name = optarg;
+    } else if(opt == 't'){
+      n_threads = atoi(optarg) > 0 ? atoi(optarg) : 1;
+    } else if(opt == 'S'){
+      setting = optarg;
+    } else if(opt == 'M'){
+      mask_text = optarg;
+    } else if(opt >= '1' && opt < '1' + MASK_CUSTOM){
+      custom[opt - '1'] = optarg;
+    } else {
+      break;
+    }
+  }
+  if(optind != argc - 1){
+    fprintf(stderr, "Usage: %s [-e auto|scalar|avx2|avx512] [-t threads] "
+            "[-S setting] [-M mask] [-1 charset] ... [-4 charset] "
+            "table_file\n", argv[0]);
+    return 1;
+  }
+  if(scheme_detect(setting) < 0){
+    fprintf(stderr, "%s is not a setting for a scheme we know\n", setting);
+    return 1;
+  }
+  if(mask_parse(&keyspace, mask_text, custom) != 0){
+    return 1;
+  }
+  keyspace_size = mask_keyspace(&keyspace);
+  if((keyspace_size + CHUNK - 1) / CHUNK > UINT32_MAX ||
+     keyspace_size > SIZE_MAX / sizeof(table_entry)){
+    fprintf(stderr, "%s is too big a keyspace for a table\n", mask_text);
+    return 1;
+  }
+  engine = sha512mb_select(engine_name);
+  if(engine < 0){
+    fprintf(stderr, "Engine %s is not available on this CPU\n", engine_name);
+    return 1;
+  }
+  entries = malloc((keyspace_size > 0 ? keyspace_size : 1) *
+                   sizeof(table_entry));
+  if(entries == NULL){
+    fprintf(stderr, "Not enough memory for %llu entries\n",
+            (unsigned long long) keyspace_size);
+    return 1;
+  }
+  contexts = malloc(n_threads * sizeof(scheme_ctx));
+  for(i=0; i<n_threads; i++){
+    scheme_ctx_init(&contexts[i]);
+  }
+  printf("Hashing %llu candidates with %s on %d threads\n",
+         (unsigned long long) keyspace_size, setting, n_threads);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  pool_run(n_threads, (keyspace_size + CHUNK - 1) / CHUNK, kernel_function,
+           contexts);
+  status = table_write(argv[optind], setting, &keyspace, entries,
+                       keyspace_size);
+  clock_gettime(CLOCK_MONOTONIC, &finish);
+  time_difference(&start, &finish, &time_elapsed);
+  if(status == 0){
+    printf("Wrote %s in %0.9lfs\n", argv[optind], time_elapsed / 1.0e9);
+  }
+
+  for(i=0; i<n_threads; i++){
+    scheme_ctx_free(&contexts[i]);
+  }
+  free(contexts);
+  free(entries);
+  return status == 0 ? 0 : 1;
+}
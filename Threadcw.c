@@ -1,9 +1,21 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include <crypt.h>
 #include <time.h>
-#include <pthread.h>
+#include <unistd.h>
+#include "sha512crypt.h"
+#include "sha512mb.h"
+#include "targets.h"
+#include "pool.h"
+#include "mask.h"
+#include "checkpoint.h"
+#include "wordlist.h"
+#include "scheme.h"
+#include "markov.h"
+#include "log.h"
+#include "meter.h"
+#include "affinity.h"
+#include "batch.h"
 
 /******************************************************************************
   Demonstrates how to crack an encrypted password using a simple
@@ -12,13 +24,61 @@
   code. 
 
   Compile with:
-    cc -o Threadcw Threadcw.c -lcrypt -pthread
+    cc -O2 -o Threadcw Threadcw.c sha512crypt.c sha512mb.c targets.c pool.c \
+       mask.c checkpoint.c wordlist.c scheme.c markov.c log.c meter.c \
+       affinity.c batch.c -pthread -lcrypt -lm
 
   If you want to analyse the results then use the redirection operator to send
   output to a file that you can view using an editor or the less utility:
 
     ./Threadcw > Threadcw_results.txt
 
+  By default there is one thread per online CPU; -t sets the thread count.
+  -a compact|scatter|cores pins the threads to CPUs by one of the policies
+  in affinity.h, and each thread then allocates its own state so that it is
+  on the thread's NUMA node. The policy is shown with the hash rate, so runs
+  with each policy can be compared.
+  -e auto|scalar|avx2|avx512 picks the SHA-512-crypt kernel as in
+  CrackAZ99-With-Data, and -M and -1 to -4 change the shape of the passwords
+  that are tried in the same way.
+
+  -P file tries the mask in order of probability rather than in mask order,
+  likeliest first, by a Markov model of the passwords in file, one per line.
+  Every candidate is still tried once. See markov.h.
+
+  -s part/parts tries only one of parts equal slices of the keyspace, from 1
+  to parts, so that a search can be shared out between machines by hand.
+
+  -f file cracks the hashes in file instead of the ones below. It can hold one
+  hash per line or be in the format of /etc/shadow.
+
+  -w file tries the words in file, one per line, instead of a mask. Each word
+  is put through every rule in the file given with -r, or through a built-in
+  set of common case changes, appended digits and leetspeak if there is no
+  -r. See wordlist.h for how rules are written. A candidate's number is then
+  the offset of its word in the file times the number of rules, plus the
+  number of the rule.
+
+  The targets can be any mix of MD5-crypt ($1$), SHA-256-crypt ($5$),
+  SHA-512-crypt ($6$) and bcrypt ($2a$, $2b$, $2y$) hashes. Chunks are sized
+  by how expensive each salt is to hash, so that they all take about as long
+  and cheap salts are not held up by expensive ones.
+
+  Passwords that are found are displayed as they are found and a summary at
+  the end. -v adds a line per chunk, -vv a line for every candidate, and -q
+  leaves only the passwords. The threads never wait for the output; it goes
+  through a writer thread, see log.h.
+
+  Every 10 seconds, or every -i seconds, the hash rate, the share of the
+  keyspace that is done and the time left are displayed; -i 0 turns this
+  off. -j file writes how many candidates and chunks each thread hashed to
+  file as JSON at the end, to show how evenly the work was spread. See
+  meter.h.
+
+  -c file keeps a record of progress in file. If the run is interrupted, run
+  it again with the same options and it carries on from where it got to,
+  redoing no more than the chunk each thread was working on.
+
   Dr Kevan Buckley, University of Wolverhampton, 2018
 ******************************************************************************/
 int n_passwords = 4;
@@ -40,81 +100,364 @@ void substr(char *dest, char *src, int start, int length){
 }
 
 /**
- This function can crack the kind of password explained above. All combinations
- that are tried are displayed and when the password is found, #, is put at the 
- start of the line. Note that one of the most time consuming operations that 
- it performs is the output of intermediate results, so performance experiments 
- for this kind of program should not include this. i.e. comment out the printfs.
+ The keyspace is split into chunks, which hold CHUNK candidates for a salt
+ with the cost of default SHA-512-crypt and proportionally more or fewer for
+ cheaper or dearer ones. There is one work item for every chunk of every salt
+ group, numbered so that neighbouring items belong to different groups, which
+ keeps every target progressing at once. Groups with bigger chunks run out of
+ chunks first, and their remaining items are empty.
 */
 
-void *function()
-{
-   int i;
-   pthread_t thread1, thread2;
-    void *kernel_function_1();
-   void *kernel_function_2();
+#define CHUNK    200    // Candidates per work item, a multiple of 8 lanes
+#define WORD_CHUNK 256  // Bytes of wordlist per work item
+
+mask keyspace;          // The shape of the passwords being tried
+uint64_t keyspace_size; // How many passwords that is
+uint64_t slice_lo;      // The part of the keyspace this run covers
+uint64_t slice_hi;
+target_set set;         // The targets, grouped by salt
+char *hash_file;        // Where the targets come from, or NULL for the above
+int engine;             // Which SHA-512-crypt kernel to hash with
+char *progress_file;    // Where progress is recorded, or NULL
+checkpoint progress;    // That file, mapped into memory
+char *wordlist_file;    // The words to try, or NULL to try the mask
+wordlist words;         // That file, mapped into memory
+rule *rules;            // What is done to each word before it is tried
+int n_rules;
+char *markov_file;      // The sample the keyspace is ordered by, or NULL
+markov order;           // The order of the keyspace when there is one
+uint32_t *chunk_size;   // Candidates, or bytes of wordlist, per chunk by group
+meter metrics;          // What each thread has done, in candidates or bytes
+int report_interval = 10; // Seconds between progress reports
+char *report_file;      // Where the JSON report goes, or NULL
+affinity placement;     // Which CPU each thread is pinned to, with -a
+
+/**
+ Everything that a thread writes to while it hashes, apart from the targets
+ it cracks, is kept in a context of its own. Each thread allocates its own
+ context in whole pages, so that threads never write to the same line and
+ the pages are on the thread's NUMA node. Contexts are kept from one chunk
+ to the next, so a salt is only parsed again when a thread moves on to a
+ chunk of a different group.
+*/
+
+typedef struct {
+  _Alignas(64) scheme_ctx scheme; // Set up for the group being hashed
+  meter_slot *counts;     // The thread's slot in metrics
+  // Mangled words are collected by length, as the candidates of a block
+  // have to be the same length, and hashed once a length has a full block
+  candidate_batch batch[WORD_MAX + 1];
+} worker_context;
 
-   for(i=0;i<n_passwords;i<i++) {
-     pthread_create(&thread1, NULL, kernel_function_1, encrypted_passwords[i]);
-     pthread_create(&thread2, NULL, kernel_function_2, encrypted_passwords[i]);
+worker_context **contexts; // One for each thread
 
-     pthread_join(thread1, NULL);
-     pthread_join(thread2, NULL);
+/**
+ Called on each thread before it hashes anything. The thread is pinned
+ first, so that its context is first written, and so placed, where it will
+ run.
+*/
+
+void start_worker(void *arg, int worker){
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t size = (sizeof(worker_context) + page - 1) / page * page;
+  worker_context *ctx;
+
+  meter_pinned(&metrics.slots[worker], affinity_pin(&placement, worker));
+  ctx = aligned_alloc(page, size);
+  memset(ctx, 0, size);
+  scheme_ctx_init(&ctx->scheme);
+  ctx->counts = &metrics.slots[worker];
+  contexts[worker] = ctx;
+}
+
+/**
+ Returns the thread's hashing context, set up for a group.
+*/
 
+scheme_ctx *context_scheme(worker_context *ctx, int group){
+  scheme_ctx_set(&ctx->scheme, set.groups[group].setting);
+  return &ctx->scheme;
+}
+
+/**
+ The candidates of one chunk, walked in mask order or, with -P, in order of
+ probability.
+*/
+
+typedef struct {
+  mask_range in_mask;
+  markov_range in_order;
+} candidate_range;
+
+void candidates_init(candidate_range *c, uint64_t lo, uint64_t hi){
+  if(markov_file){
+    markov_range_init(&c->in_order, &order, lo, hi);
+  } else {
+    mask_range_init(&c->in_mask, &keyspace, lo, hi);
   }
 }
 
-void *kernel_function_1(char *salt_and_encrypted){
-  int r, s, t;     // Loop counters
-  char salt[7];    // String used in hashing the password. Need space for \0
-  char plain[7];   // The combination of letters currently being checked
-  char *enc;       // Pointer to the encrypted password
-  int count = 0;   // The number of combinations explored so far
-
-  substr(salt, salt_and_encrypted, 0, 6);
-
-  for(r='A'; r<='M'; r++){
-    for(s='A'; s<='Z'; s++){
-      for(t=0; t<=99; t++){
-        sprintf(plain, "%c%c%02d", r, s, t); 
-        enc = (char *) crypt(plain, salt);
-        count++;
-        if(strcmp(salt_and_encrypted, enc) == 0){
-          printf("#%-8d%s %s\n", count, plain, enc);
+int candidates_fill(candidate_range *c, candidate_batch *b){
+  return markov_file ? batch_fill_markov(b, &c->in_order) :
+                       batch_fill_mask(b, &c->in_mask);
+}
+
+/**
+ Looks up a block's digests in a salt group and displays the passwords that
+ they crack, and with -vv every candidate.
+*/
+
+void check_batch(int group, const candidate_batch *b,
+                 const unsigned char (*digest)[SHA512CRYPT_DIGEST_LEN]){
+  int found[BATCH_SIZE];
+  int t, f;
+
+  if(log_enabled(LOG_ATTEMPT)){
+    for(t=0; t<b->n; t++){
+      log_printf(LOG_ATTEMPT, " %-8llu%s",
+                 (unsigned long long) (b->index[t] + 1), b->plain[t]);
+    }
+  }
+  if(batch_match(b, &set, group, digest, found) == 0){
+    return;
+  }
+  for(t=0; t<b->n; t++){
+    for(f=found[t]; f>=0; f=set.targets[f].next){
+      if(targets_crack(&set, f, b->index[t])){
+        if(progress_file){
+          checkpoint_found(&progress, f, b->index[t]);
         }
-// else {
-         // printf(" %-8d%s %s\n", count, plain, enc);
-        //}
+        log_printf(LOG_RESULT, "#%-8llu%s %.*s",
+                   (unsigned long long) (b->index[t] + 1), b->plain[t],
+                   set.targets[f].hash_len, set.targets[f].hash);
       }
     }
   }
-  printf("%d solutions explored\n", count);
 }
-void *kernel_function_2(char *salt_and_encrypted){
-  int x, y, z;     // Loop counters
-  char salt[7];    // String used in hashing the password. Need space for \0
-  char plain[7];   // The combination of letters currently being checked
-  char *enc;       // Pointer to the encrypted password
-  int count = 0;   // The number of combinations explored so far
-
-  substr(salt, salt_and_encrypted, 0, 6);
-
-  for(x='N'; x<='Z'; x++){
-    for(y='A'; y<='Z'; y++){
-      for(z=0; z<=99; z++){
-        sprintf(plain, "%c%c%02d", x, y, z); 
-        enc = (char *) crypt(plain, salt);
-        count++;
-        if(strcmp(salt_and_encrypted, enc) == 0){
-          printf("#%-8d%s %s\n", count, plain, enc);
-        } //else {
-         // printf(" %-8d%s %s\n", count, plain, enc);
-       // }
+
+/**
+ This function can crack the kind of password explained above. It is called
+ by the pool for one chunk of one salt group and displays the passwords that
+ it finds, with # at the start of the line. Chunks of a salt whose targets
+ have all been found are skipped, and once every target has been found it
+ returns 1 so that the pool stops handing out chunks.
+*/
+
+int kernel_function(void *arg, int worker, uint32_t item){
+  int group = item % set.n_groups;
+  uint64_t chunk = chunk_size[group];
+  uint64_t first = slice_lo + (uint64_t) (item / set.n_groups) * chunk;
+  uint64_t last = slice_hi - first > chunk ? first + chunk : slice_hi;
+  candidate_range range;
+  candidate_batch b;
+  unsigned char digest[BATCH_SIZE][SHA512CRYPT_DIGEST_LEN];
+  worker_context *ctx = contexts[worker];
+  scheme_ctx *scheme;
+
+  if(first >= slice_hi || group_remaining(&set, group) == 0 ||
+     (progress_file && checkpoint_is_done(&progress, item))){
+    meter_done(ctx->counts, first < slice_hi ? last - first : 0);
+    return targets_remaining(&set) == 0;
+  }
+  scheme = context_scheme(ctx, group);
+  candidates_init(&range, first, last);
+  while(candidates_fill(&range, &b) > 0){
+    batch_hash(&b, scheme, engine, digest);
+    check_batch(group, &b, digest);
+    meter_hashed(ctx->counts, b.n);
+  }
+  if(progress_file){
+    checkpoint_mark_done(&progress, item);
+  }
+  meter_chunk(ctx->counts, last - first);
+  log_printf(LOG_PROGRESS, "Thread %d hashed candidates %llu to %llu with %s",
+             worker, (unsigned long long) first, (unsigned long long) last,
+             set.groups[group].setting);
+  return targets_remaining(&set) == 0;
+}
+
+void hash_words(worker_context *ctx, int group, candidate_batch *b){
+  unsigned char digest[BATCH_SIZE][SHA512CRYPT_DIGEST_LEN];
+
+  batch_hash(b, &ctx->scheme, engine, digest);
+  check_batch(group, b, digest);
+  meter_hashed(ctx->counts, b->n);
+  b->n = 0;
+}
+
+/**
+ The wordlist version of kernel_function(). A work item is the words that
+ start in one chunk of the wordlist, for one salt group, with every rule
+ applied to each of them. Chunks are WORD_CHUNK bytes, scaled by cost.
+*/
+
+int words_function(void *arg, int worker, uint32_t item){
+  int group = item % set.n_groups;
+  size_t chunk = chunk_size[group];
+  size_t begin = (size_t) (item / set.n_groups) * chunk;
+  size_t end = words.size - begin > chunk ? begin + chunk : words.size;
+  worker_context *ctx = contexts[worker];
+  candidate_batch *batch = ctx->batch;
+  char plain[WORD_MAX + 1];
+  const char *p, *last, *word;
+  int len, r, n;
+
+  if(begin >= words.size || group_remaining(&set, group) == 0 ||
+     (progress_file && checkpoint_is_done(&progress, item))){
+    meter_done(ctx->counts, begin < words.size ? end - begin : 0);
+    return targets_remaining(&set) == 0;
+  }
+  context_scheme(ctx, group);
+  for(n=0; n<=WORD_MAX; n++){
+    batch_init(&batch[n], n);
+  }
+
+  p = wordlist_range(&words, begin, begin + chunk, &last);
+  while(p < last && group_remaining(&set, group) > 0){
+    uint64_t offset = p - words.map;
+
+    p = wordlist_next(&words, p, &word, &len);
+    if(len <= 0){
+      continue;
+    }
+    for(r=0; r<n_rules; r++){
+      n = rule_apply(&rules[r], word, len, plain);
+      if(n >= 0 && batch_add(&batch[n], plain, offset * n_rules + r)){
+        hash_words(ctx, group, &batch[n]);
       }
     }
   }
-  printf("%d solutions explored\n", count);
+  for(n=1; n<=WORD_MAX; n++){
+    if(batch[n].n > 0){
+      hash_words(ctx, group, &batch[n]);
+    }
+  }
+
+  if(progress_file){
+    checkpoint_mark_done(&progress, item);
+  }
+  meter_chunk(ctx->counts, end - begin);
+  log_printf(LOG_PROGRESS, "Thread %d tried bytes %llu to %llu of %s with %s",
+             worker, (unsigned long long) begin,
+             (unsigned long long) end, wordlist_file,
+             set.groups[group].setting);
+  return targets_remaining(&set) == 0;
+}
+
+/**
+ Maps the progress file and takes back the targets that an earlier run had
+ already cracked. job identifies the options the run was started with.
+ Returns 0 if the run can go ahead.
+*/
+
+int resume(uint64_t job, uint32_t n_items){
+  char chunk[16];
+  int i, resumed, cracked = 0;
+
+  snprintf(chunk, sizeof(chunk), "%d", CHUNK);
+  job = checkpoint_job(job, chunk, strlen(chunk));
+  for(i=0; i<set.n_targets; i++){
+    job = checkpoint_job(job, set.targets[i].hash, set.targets[i].hash_len);
+  }
+  resumed = checkpoint_open(&progress, progress_file, job, n_items,
+                            set.n_targets);
+  if(resumed <= 0){
+    return resumed;
+  }
+  for(i=0; i<set.n_targets; i++){
+    uint64_t found = atomic_load(&progress.found[i]);
+    if(found != 0 && targets_crack(&set, i, found - 1)){
+      cracked++;
+    }
+  }
+  log_printf(LOG_INFO, "Resuming from %s: %u of %u chunks done, %d targets "
+             "cracked", progress_file, checkpoint_count_done(&progress),
+             n_items, cracked);
+  return 0;
 }
+
+/**
+ Cracks every password on a pool of n_threads threads.
+*/
+
+void function(int n_threads, uint64_t job)
+{
+  int i;
+  uint64_t size = wordlist_file ? words.size : slice_hi - slice_lo;
+  uint64_t n_chunks = 0;  // Chunks in the group with the smallest chunks
+  pool_fn fn = wordlist_file ? words_function : kernel_function;
+  meter_count *counts;
+
+  if(hash_file){
+    if(targets_load_file(&set, hash_file) < 0){
+      return;
+    }
+  } else {
+    targets_load(&set, encrypted_passwords, n_passwords);
+  }
+  chunk_size = malloc((set.n_groups > 0 ? set.n_groups : 1) *
+                      sizeof(uint32_t));
+  for(i=0; i<set.n_groups; i++){
+    uint64_t n;
+
+    // Lanes are fixed at the most any engine has, not the engine in use, so
+    // the chunks are the same whichever engine resumes a run
+    chunk_size[i] = wordlist_file ?
+                    scheme_chunk(set.groups[i].setting, WORD_CHUNK, 1) :
+                    scheme_chunk(set.groups[i].setting, CHUNK,
+                                 SHA512MB_LANES_MAX);
+    n = size / chunk_size[i] + (size % chunk_size[i] != 0);
+    if(n > n_chunks){
+      n_chunks = n;
+    }
+  }
+  contexts = calloc(n_threads, sizeof(worker_context *));
+  meter_init(&metrics, n_threads, size * set.n_groups);
+  if(placement.policy != AFFINITY_NONE){
+    metrics.affinity = affinity_name(placement.policy);
+  }
+
+  if(n_chunks * set.n_groups > UINT32_MAX){
+    fprintf(stderr, "Too many candidates to split into chunks\n");
+  } else if(!progress_file || resume(job, n_chunks * set.n_groups) == 0){
+    meter_start(&metrics, report_interval);
+    pool_run_start(n_threads, n_chunks * set.n_groups, fn, start_worker,
+                   NULL);
+    meter_stop(&metrics);
+    if(progress_file){
+      checkpoint_close(&progress);
+    }
+  }
+
+  counts = malloc(n_threads * sizeof(meter_count));
+  meter_counts(&metrics, 0, n_threads, counts);
+  for(i=0; i<n_threads; i++){
+    if(counts[i].cpu >= 0){
+      log_printf(LOG_INFO, "%llu solutions explored by thread %d on CPU %lld",
+                 (unsigned long long) counts[i].hashed, i,
+                 (long long) counts[i].cpu);
+    } else {
+      log_printf(LOG_INFO, "%llu solutions explored by thread %d",
+                 (unsigned long long) counts[i].hashed, i);
+    }
+    // A thread that could not be started has no context
+    if(contexts[i]){
+      scheme_ctx_free(&contexts[i]->scheme);
+      free(contexts[i]);
+    }
+  }
+  targets_summary(&set);
+  if(report_file){
+    meter_json(report_file, "Threadcw", metrics.affinity,
+               meter_seconds(&metrics), 1, &n_threads, counts);
+  }
+  free(counts);
+  meter_free(&metrics);
+  free(contexts);
+  free(chunk_size);
+  targets_free(&set);
+}
+
 int time_difference(struct timespec *start, struct timespec *finish, 
                               long long int *difference) {
   long long int ds =  finish->tv_sec - start->tv_sec; 
@@ -129,21 +472,149 @@ int time_difference(struct timespec *start, struct timespec *finish,
 }
 
 int main(int argc, char *argv[]){
-  
+  int opt;
+  int n_threads = pool_default_workers();
+  char *engine_name = "auto";
+  char *mask_text = "?u?u?d?d";
+  char *custom[MASK_CUSTOM] = {0};
+  char *rules_file = NULL;
+  char *slice = NULL;
+  int policy = AFFINITY_NONE;
+  unsigned long long part = 1, parts = 1;
+  uint64_t job;
+  int trained = 0;      // Passwords the Markov model was learnt from
 struct timespec start, finish;   
   long long int time_elapsed;
 
+  while((opt = getopt(argc, argv, "e:t:a:c:f:w:r:s:P:M:1:2:3:4:i:j:vq")) != -1){
+    if(opt == 'e'){
+      engine_name = optarg;
+    } else if(opt == 't'){
+      n_threads = atoi(optarg);
+    } else if(opt == 'a'){
+      if((policy = affinity_parse(optarg)) < 0){
+        return 1;
+      }
+    } else if(opt == 'c'){
+      progress_file = optarg;
+    } else if(opt == 'f'){
+      hash_file = optarg;
+    } else if(opt == 'w'){
+      wordlist_file = optarg;
+    } else if(opt == 'r'){
+      rules_file = optarg;
+    } else if(opt == 's'){
+      slice = optarg;
+    } else if(opt == 'P'){
+      markov_file = optarg;
+    } else if(opt == 'M'){
+      mask_text = optarg;
+    } else if(opt >= '1' && opt < '1' + MASK_CUSTOM){
+      custom[opt - '1'] = optarg;
+    } else if(opt == 'i'){
+      report_interval = atoi(optarg);
+    } else if(opt == 'j'){
+      report_file = optarg;
+    } else if(opt == 'v'){
+      log_verbosity++;
+    } else if(opt == 'q'){
+      log_verbosity--;
+    } else {
+      fprintf(stderr, "Usage: %s [-e auto|scalar|avx2|avx512] [-t threads] "
+              "[-a compact|scatter|cores] [-c progress_file] [-f hash_file] "
+              "[-w wordlist [-r rules]] [-s part/parts] [-P sample] "
+              "[-M mask] [-1 charset] ... [-4 charset] [-i seconds] "
+              "[-j report] [-v | -q]\n", argv[0]);
+      return 1;
+    }
+  }
+  if(wordlist_file && (markov_file || slice)){
+    fprintf(stderr, "-%c only applies to a mask, not to -w\n",
+            markov_file ? 'P' : 's');
+    return 1;
+  }
+  if(mask_parse(&keyspace, mask_text, custom) != 0){
+    return 1;
+  }
+  keyspace_size = mask_keyspace(&keyspace);
+  if(keyspace_size == UINT64_MAX && !wordlist_file){
+    fprintf(stderr, "%s has too many candidates to count\n", mask_text);
+    return 1;
+  }
+  if(slice && (sscanf(slice, "%llu/%llu", &part, &parts) != 2 || part < 1 ||
+               part > parts)){
+    fprintf(stderr, "-s needs part/parts, such as 2/5\n");
+    return 1;
+  }
+  slice_lo = mask_split(keyspace_size, parts, part - 1);
+  slice_hi = mask_split(keyspace_size, parts, part);
+  job = checkpoint_job(0, mask_text, strlen(mask_text));
+  job = checkpoint_job(job, slice ? slice : "", slice ? strlen(slice) : 0);
+  for(opt=0; opt<MASK_CUSTOM; opt++){
+    job = checkpoint_job(job, custom[opt] ? custom[opt] : "",
+                         custom[opt] ? strlen(custom[opt]) : 0);
+  }
+  if(markov_file){
+    markov_stats *stats = malloc(sizeof(markov_stats));
+
+    trained = markov_train(stats, markov_file);
+    if(trained < 0 || markov_init(&order, &keyspace, stats) != 0){
+      return 1;
+    }
+    free(stats);
+    job = checkpoint_job_file(job, markov_file);
+  }
+  if(wordlist_file){
+    if(wordlist_open(&words, wordlist_file) != 0){
+      return 1;
+    }
+    n_rules = rules_file ? rules_load(&rules, rules_file) :
+                           rules_default(&rules);
+    if(n_rules <= 0){
+      fprintf(stderr, "There are no rules to apply\n");
+      return 1;
+    }
+    job = checkpoint_job_file(0, wordlist_file);
+    job = rules_file ? checkpoint_job_file(job, rules_file) :
+                       checkpoint_job(job, "", 0);
+  }
+  engine = sha512mb_select(engine_name);
+  if(engine < 0){
+    fprintf(stderr, "Engine %s is not available on this CPU\n", engine_name);
+    return 1;
+  }
+  if(n_threads < 1){
+    n_threads = 1;
+  }
+  if(affinity_init(&placement, policy) != 0){
+    return 1;
+  }
+
+  // Nothing may be written to stdout before log_open() sets its buffer
+  log_open(stdout);
+  if(markov_file){
+    log_printf(LOG_INFO, "Trying candidates in order of probability from %d "
+               "passwords", trained);
+  }
   clock_gettime(CLOCK_MONOTONIC, &start);
  
   
   
-    function();
+    function(n_threads, job);
   
 
   clock_gettime(CLOCK_MONOTONIC, &finish);
+  log_close();
   time_difference(&start, &finish, &time_elapsed);
   printf("Time elapsed was %lldns or %0.9lfs\n", time_elapsed, 
          (time_elapsed/1.0e9)); 
 
+  if(wordlist_file){
+    wordlist_close(&words);
+    free(rules);
+  } else if(markov_file){
+    markov_free(&order);
+  }
+  affinity_free(&placement);
   return 0;
 }
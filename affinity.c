@@ -0,0 +1,168 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include "affinity.h"
+
+/******************************************************************************
+  CPU topology and thread pinning. See affinity.h.
+
+  Link into a cracker with:
+    cc -O2 -o Threadcw Threadcw.c sha512crypt.c sha512mb.c targets.c pool.c \
+       mask.c checkpoint.c wordlist.c scheme.c markov.c log.c meter.c \
+       affinity.c batch.c -pthread -lcrypt -lm
+******************************************************************************/
+
+static const char *names[] = {"none", "compact", "scatter", "cores"};
+
+typedef struct {
+  int cpu;
+  int package;      // The socket
+  int core;         // The physical core within the socket
+  int sibling;      // Which SMT thread of the core, 0 for the first
+} cpu_info;
+
+/**
+ Returns the policy called name, or -1 if there is none.
+*/
+
+int affinity_parse(const char *name){
+  int i;
+
+  for(i=0; i<(int) (sizeof(names) / sizeof(names[0])); i++){
+    if(strcmp(name, names[i]) == 0){
+      return i;
+    }
+  }
+  fprintf(stderr, "Affinity %s is not one of none, compact, scatter and "
+          "cores\n", name);
+  return -1;
+}
+
+const char *affinity_name(int policy){
+  return names[policy];
+}
+
+/**
+ Reads one number from a topology file of cpu, or returns fallback if the
+ kernel does not provide it.
+*/
+
+static int read_topology(int cpu, const char *file, int fallback){
+  char path[128];
+  FILE *f;
+  int value;
+
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s",
+           cpu, file);
+  f = fopen(path, "r");
+  if(f == NULL){
+    return fallback;
+  }
+  if(fscanf(f, "%d", &value) != 1){
+    value = fallback;
+  }
+  fclose(f);
+  return value;
+}
+
+static int compare_compact(const void *a, const void *b){
+  const cpu_info *x = a, *y = b;
+
+  if(x->package != y->package){
+    return x->package - y->package;
+  }
+  if(x->core != y->core){
+    return x->core - y->core;
+  }
+  return x->sibling - y->sibling;
+}
+
+static int compare_scatter(const void *a, const void *b){
+  const cpu_info *x = a, *y = b;
+
+  if(x->sibling != y->sibling){
+    return x->sibling - y->sibling;
+  }
+  if(x->core != y->core){
+    return x->core - y->core;
+  }
+  return x->package - y->package;
+}
+
+/**
+ Makes the plan for a policy from the CPUs that the process may run on,
+ which mpirun's or taskset's binding may have narrowed down. Returns 0, or
+ -1 if the CPUs cannot be found out.
+*/
+
+int affinity_init(affinity *a, int policy){
+  cpu_set_t allowed;
+  cpu_info *info;
+  int cpu, i, n = 0;
+
+  a->policy = policy;
+  a->n_cpus = 0;
+  a->cpus = NULL;
+  if(policy == AFFINITY_NONE){
+    return 0;
+  }
+  if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0){
+    perror("sched_getaffinity");
+    return -1;
+  }
+  info = malloc(CPU_COUNT(&allowed) * sizeof(cpu_info));
+  for(cpu=0; cpu<CPU_SETSIZE; cpu++){
+    if(!CPU_ISSET(cpu, &allowed)){
+      continue;
+    }
+    info[n].cpu = cpu;
+    info[n].package = read_topology(cpu, "physical_package_id", 0);
+    info[n].core = read_topology(cpu, "core_id", cpu);
+    info[n].sibling = 0;
+    for(i=0; i<n; i++){
+      if(info[i].package == info[n].package && info[i].core == info[n].core){
+        info[n].sibling++;
+      }
+    }
+    n++;
+  }
+
+  qsort(info, n, sizeof(cpu_info),
+        policy == AFFINITY_SCATTER ? compare_scatter : compare_compact);
+  a->cpus = malloc((n > 0 ? n : 1) * sizeof(int));
+  for(i=0; i<n; i++){
+    if(policy != AFFINITY_CORES || info[i].sibling == 0){
+      a->cpus[a->n_cpus++] = info[i].cpu;
+    }
+  }
+  free(info);
+  return 0;
+}
+
+/**
+ Pins the calling thread to its CPU in the plan. Returns the CPU, or -1 if
+ the thread was left to float.
+*/
+
+int affinity_pin(const affinity *a, int worker){
+  cpu_set_t set;
+  int cpu;
+
+  if(a->n_cpus == 0){
+    return -1;
+  }
+  cpu = a->cpus[worker % a->n_cpus];
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if(pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0){
+    return -1;
+  }
+  return cpu;
+}
+
+void affinity_free(affinity *a){
+  free(a->cpus);
+}
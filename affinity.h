@@ -0,0 +1,39 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+/******************************************************************************
+  Pinning worker threads to CPUs. Threads that the scheduler moves around
+  lose their caches each time, and on a machine with more than one socket
+  they can end up far from their memory. With a policy, worker w is pinned
+  to the w-th CPU of a plan made from the CPUs the process may run on, as
+  read from /sys/devices/system/cpu:
+
+    compact   fill one socket, core by core and SMT sibling by sibling,
+              before moving on to the next, so threads share caches
+    scatter   spread across sockets first, then cores, with SMT siblings
+              last, so each thread has as much cache and turbo as it can
+    cores     one thread per physical core, never two on SMT siblings
+
+  If there are more workers than CPUs in the plan they wrap around. A pinned
+  thread should allocate and first write its own state after pinning, so
+  that the kernel places the pages on the thread's own NUMA node.
+******************************************************************************/
+
+#define AFFINITY_NONE    0
+#define AFFINITY_COMPACT 1
+#define AFFINITY_SCATTER 2
+#define AFFINITY_CORES   3
+
+typedef struct {
+  int policy;
+  int n_cpus;
+  int *cpus;        // The plan: the CPU for each worker in turn
+} affinity;
+
+int affinity_parse(const char *name);
+const char *affinity_name(int policy);
+int affinity_init(affinity *a, int policy);
+int affinity_pin(const affinity *a, int worker);
+void affinity_free(affinity *a);
+
+#endif
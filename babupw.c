@@ -3,24 +3,86 @@
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
-#include <crypt.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <mpi.h>
+#include "sha512crypt.h"
+#include "sha512mb.h"
+#include "targets.h"
+#include "mask.h"
+#include "scheme.h"
+#include "markov.h"
+#include "log.h"
+#include "meter.h"
+#include "affinity.h"
+#include "batch.h"
 
 /*****************************************************************************
 The variable names and the function names of this program is same as provided by the university.
 The added variable and function are the only changes made to this program.
-  
+
+The keyspace is cut into chunks for each salt, of CHUNK candidates for one
+with the cost of default SHA-512-crypt and proportionally more or fewer for
+cheaper or dearer ones, so that every chunk takes about as long. The targets
+can be any mix of $1$, $5$, $6$ and bcrypt hashes. Rank 0 is
+the coordinator: it hands chunks out to the other ranks whenever they ask for
+one, while its own threads hash chunks too. Ranks on faster nodes simply ask
+more often, so any number of ranks can be used.
+
+Each rank hashes on a pool of threads, -t of them (1 by default), so one
+rank per node or per socket is enough, rather than one per core. The rank's
+main thread does all of its MPI calls: it keeps a small queue of chunks
+filled for the hashing threads, and on rank 0 it also answers the other
+ranks' requests. Different ranks can be given different thread counts with
+mpirun's colon syntax, for instance
+    mpirun -n 1 ./babupw -t 16 : -n 3 ./babupw -t 32
+
+A rank that cracks a target tells every other rank straight away with a non
+blocking send. Each rank keeps a receive posted for these messages and tests
+it every millisecond, so the others drop a solved salt in the middle of a
+chunk and the coordinator stops handing out work once every target has been
+found.
+
+By default the passwords tried are 2 uppercase letters and a 4 digit integer.
+-M and -1 to -4 change that as in CrackAZ99-With-Data, and -e picks the
+SHA-512-crypt kernel. -f file cracks the hashes in file, one per line or in
+the format of /etc/shadow, instead of the ones below; every rank reads it.
+-P file tries the candidates in order of probability, likeliest first, by
+a Markov model of the passwords in file, as in Threadcw. -v displays a line
+per chunk, -vv a line per candidate and -q only the passwords found. Each
+rank's output goes through a writer thread, see log.h, so hashing never
+waits for it.
+
+Every 10 seconds, or every -i seconds, rank 0 displays the hash rate of all
+the ranks, the share of the chunks that are done and the time left; -i 0
+turns this off. The other ranks send their counts with each request for a
+chunk, so this costs no extra messages. -j file has rank 0 write how many
+candidates and chunks each thread of each rank hashed to file as JSON at
+the end. See meter.h.
+
+-a compact|scatter|cores pins the hashing threads to CPUs by one of the
+policies in affinity.h, and each thread then allocates its own state so
+that it is on the thread's NUMA node. Ranks on the same node take places in
+the plan one after the other, so they do not pile onto the same CPUs; if
+mpirun already binds each rank to as many CPUs as it has threads, the plan
+is made from those and comes to the same thing.
 
 To compile:
-     mpicc -o babupw babupw.c -lrt -lcrypt
-     
+     mpicc -O2 -o babupw babupw.c sha512crypt.c sha512mb.c targets.c mask.c \
+           scheme.c markov.c wordlist.c log.c meter.c affinity.c batch.c \
+           -lrt -pthread -lcrypt -lm
+
   To run 3 processes on this computer:
     mpirun -n 3 ./babupw >result.txt
 *****************************************************************************/
 
+#define CHUNK       1000  // Candidates per chunk, a multiple of 8 lanes
+#define TAG_REQUEST 1     // Worker to coordinator: send me a chunk
+#define TAG_WORK    2     // Coordinator to worker: a chunk, or NO_MORE_WORK
+#define TAG_FOUND   3     // Any rank to all others: target, candidate number
+#define NO_MORE_WORK UINT32_MAX
 
 int n_passwords = 4;
-pthread_t t1, t2;
 char *encrypted_passwords[] = {
 "$6$KB$/qYEV93N/mW7XZ14YzQf07RSkZmhs3S6rwb06oKRQ9eNk6cg1x3NcnFp7uIbi30hTX6ZNb04xsyyVTrCWIrTW.",
   "$6$KB$pWbhk/RfwwSRZIfvVB16Wxu3e8UWxGwQSwWpLAw4qOo.2a.oiPowz2ZHby52Noh08WPUqTJO5Nny.phpFiq011",
@@ -28,127 +90,648 @@ char *encrypted_passwords[] = {
   "$6$KB$8VSDL//Ale6pVSBrwWoRfTpuluOK1xf.uW6Ay6ba0jmQM4pZpFsPTI6DO7z/yLdZKGZvkQjLT6jHzJ2SiDzZi1"
 };
 
+mask keyspace;
+uint64_t keyspace_size;
+target_set set;
+char *hash_file = NULL;
+char *markov_file = NULL; // The sample the keyspace is ordered by, or NULL
+markov order;
+int engine;
+uint32_t n_items;     // Chunks of every salt group
+uint32_t *chunk_size; // Candidates per chunk, by salt group
+uint32_t next_item;   // The coordinator's next chunk to hand out
+int active_workers;   // Workers the coordinator has not yet told to stop
+int rank, size;
+uint64_t found_in[2]; // Where the posted receive puts a found message
+MPI_Request found_request;
+int found_received = 0;
+uint64_t (*found_out)[2]; // One message per target this rank cracks
+MPI_Request *found_sends;
+int found_sent = 0;   // Messages in found_out that have been sent
+int found_ready = 0;  // Messages in found_out that threads have written
+meter metrics;        // Slots for this rank's threads and, on rank 0, one for
+                      // its main thread and one for each other rank
+int report_interval = 10; // Seconds between progress reports
+char *report_file = NULL; // Where rank 0 writes the JSON report, or NULL
+affinity placement;   // Which CPU each thread is pinned to, with -a
+int first_place = 0;  // This rank's first thread's place in the plan
+
+/**
+ The hashing threads' state. Each thread allocates a context of its own in
+ whole pages, after it has been pinned, so the pages are on its NUMA node.
+ The only things threads share are the queue, behind lock, and the targets.
+*/
+
+typedef struct {
+  _Alignas(64) scheme_ctx scheme; // Set up for the group being hashed
+  meter_slot *counts;   // The thread's slot in metrics
+} thread_context;
+
+int n_threads = 1;
+thread_context **contexts;
+pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t work_ready = PTHREAD_COND_INITIALIZER;
+uint32_t *queue;      // Chunks waiting for a thread, a ring of n_threads
+int queue_head = 0, queue_len = 0;
+int no_more_work = 0; // Set once this rank will be given no more chunks
+int running_threads;  // Hashing threads that have not finished
+
 void substr(char *dest, char *src, int start, int length){
   memcpy(dest, src + start, length);
   *(dest + length) = '\0';
 }
-  
-void kernel_function1(char *salt_and_encrypted){
-  int i, o, u;     
-  char salt[7];    
-
-  char plain[7];   
-  char *enc;       
-  int count = 0;   
-
-  substr(salt, salt_and_encrypted, 0, 6);
-  
-  for(i='A'; i<='M'; i++){
-    for(o='A'; o<='Z'; o++){
-      for(u=0; u<=9999; u++){
-	//printf("Instance 1:");
-	sprintf(plain, "%c%c%02d",i, o, u);
-	enc = (char *) crypt(plain, salt);
-	count++;
-	if(strcmp(salt_and_encrypted, enc) == 0){
-	  printf("#%-8d%s %s\n", count, plain, enc);
-	} else {
+
+/**
+ Called by a hashing thread that has cracked target t. The message is sent
+ by the main thread, the next time it calls send_found().
+*/
+
+void announce_found(int t, uint64_t index){
+  pthread_mutex_lock(&lock);
+  found_out[found_ready][0] = t;
+  found_out[found_ready][1] = index;
+  found_ready++;
+  pthread_mutex_unlock(&lock);
+}
+
+/**
+ Tells every other rank about the targets this rank's threads have cracked
+ since the last call.
+*/
+
+void send_found(void){
+  int r, n, ready;
+
+  pthread_mutex_lock(&lock);
+  ready = found_ready;
+  pthread_mutex_unlock(&lock);
+  for(; found_sent<ready; found_sent++){
+    n = 0;
+    for(r=0; r<size; r++){
+      if(r != rank){
+        MPI_Isend(found_out[found_sent], 2, MPI_UINT64_T, r, TAG_FOUND,
+                  MPI_COMM_WORLD, &found_sends[found_sent * (size - 1) + n++]);
       }
+    }
+  }
+}
+
+/**
+ Records any targets other ranks have cracked since the last call. Costs one
+ MPI_Test when there is no news.
+*/
+
+void check_found(void){
+  int flag;
+
+  for(;;){
+    MPI_Test(&found_request, &flag, MPI_STATUS_IGNORE);
+    if(!flag){
+      return;
+    }
+    targets_crack(&set, (int) found_in[0], found_in[1]);
+    found_received++;
+    MPI_Irecv(found_in, 2, MPI_UINT64_T, MPI_ANY_SOURCE, TAG_FOUND,
+              MPI_COMM_WORLD, &found_request);
+  }
+}
+
+/**
+ Once every rank has stopped hashing, waits for the found messages that are
+ still in flight, so none is left unmatched when MPI is shut down.
+*/
+
+void finish_found(void){
+  int total, posted = 1;
+
+  MPI_Allreduce(&found_sent, &total, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  while(found_received < total - found_sent){
+    MPI_Wait(&found_request, MPI_STATUS_IGNORE);
+    targets_crack(&set, (int) found_in[0], found_in[1]);
+    found_received++;
+    if(found_received < total - found_sent){
+      MPI_Irecv(found_in, 2, MPI_UINT64_T, MPI_ANY_SOURCE, TAG_FOUND,
+                MPI_COMM_WORLD, &found_request);
+    } else {
+      posted = 0;
+    }
+  }
+  if(posted){
+    MPI_Cancel(&found_request);
+    MPI_Wait(&found_request, MPI_STATUS_IGNORE);
+  }
+  MPI_Waitall(found_sent * (size - 1), found_sends, MPI_STATUSES_IGNORE);
 }
+
+/**
+ Returns the coordinator's next chunk to hand out, or NO_MORE_WORK. Chunks
+ past the end of their group's keyspace, which groups with big chunks have,
+ and chunks of groups that have been cracked are passed over.
+*/
+
+uint32_t next_chunk(void){
+  while(next_item < n_items && targets_remaining(&set) > 0){
+    uint32_t item = next_item++;
+    int group = item % set.n_groups;
+
+    if((uint64_t) (item / set.n_groups) * chunk_size[group] < keyspace_size &&
+       group_remaining(&set, group) > 0){
+      return item;
+    }
+    meter_done(&metrics.slots[n_threads], 1);
+  }
+  return NO_MORE_WORK;
+}
+
+/**
+ Answers every chunk request that is waiting. Only called on the coordinator,
+ whose main thread does nothing else but poll, so workers are never kept
+ waiting long.
+*/
+
+void serve_requests(void){
+  MPI_Status status;
+  meter_count counts;
+  uint32_t item;
+  int flag;
+
+  for(;;){
+    MPI_Iprobe(MPI_ANY_SOURCE, TAG_REQUEST, MPI_COMM_WORLD, &flag, &status);
+    if(!flag){
+      return;
+    }
+    MPI_Recv(&counts, METER_WORDS, MPI_UINT64_T, status.MPI_SOURCE, TAG_REQUEST,
+             MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    meter_set(&metrics.slots[n_threads + status.MPI_SOURCE], &counts);
+    item = next_chunk();
+    if(item == NO_MORE_WORK){
+      active_workers--;
     }
+    MPI_Send(&item, 1, MPI_UINT32_T, status.MPI_SOURCE, TAG_WORK,
+             MPI_COMM_WORLD);
+  }
+}
+
+/**
+ The candidates of one chunk, walked in mask order or, with -P, in order of
+ probability.
+*/
+
+typedef struct {
+  mask_range in_mask;
+  markov_range in_order;
+} candidate_range;
+
+void candidates_init(candidate_range *c, uint64_t lo, uint64_t hi){
+  if(markov_file){
+    markov_range_init(&c->in_order, &order, lo, hi);
+  } else {
+    mask_range_init(&c->in_mask, &keyspace, lo, hi);
   }
-  printf("%d solutions explored\n", count);
 }
-void kernel_function2(char *salt_and_encrypted){
-  int p, q, r;     
-  char salt[7];    
 
-  char plain[7];   
-  char *enc;       
-  int count = 0;  
+int candidates_fill(candidate_range *c, candidate_batch *b){
+  return markov_file ? batch_fill_markov(b, &c->in_order) :
+                       batch_fill_mask(b, &c->in_mask);
+}
+
+/**
+ Hashes one chunk of one salt group, giving up as soon as every target with
+ that salt has been found here or elsewhere. The chunks are numbered so that
+ neighbouring chunks belong to different groups.
+*/
 
-  substr(salt, salt_and_encrypted, 0, 6);
-  
-  for(p='N'; p<='Z'; p++){
-    for(q='A'; q<='Z'; q++){
-      for(r=0; r<=9999; r++){
-	//printf("Instance 2:");
-	sprintf(plain, "%c%c%02d",p, q, r);
-	enc = (char *) crypt(plain, salt);
-	count++;
-	if(strcmp(salt_and_encrypted, enc) == 0){
-	  printf("#%-8d%s %s\n", count, plain, enc);
-	} else {
+void kernel_function(thread_context *ctx, uint32_t item){
+  int group = item % set.n_groups;
+  uint64_t chunk = chunk_size[group];
+  uint64_t first = (uint64_t) (item / set.n_groups) * chunk;
+  uint64_t last = keyspace_size - first > chunk ? first + chunk : keyspace_size;
+  candidate_range range;
+  candidate_batch b;
+  unsigned char digest[BATCH_SIZE][SHA512CRYPT_DIGEST_LEN];
+  int found[BATCH_SIZE];
+  int t, f;
+
+  if(group_remaining(&set, group) == 0){
+    meter_done(ctx->counts, 1);
+    return;
+  }
+  // Set up again only when the group changes, as a hash file can have
+  // millions of distinct salts
+  scheme_ctx_set(&ctx->scheme, set.groups[group].setting);
+  candidates_init(&range, first, last);
+  while(group_remaining(&set, group) > 0 && candidates_fill(&range, &b) > 0){
+    batch_hash(&b, &ctx->scheme, engine, digest);
+    for(t=0; log_enabled(LOG_ATTEMPT) && t<b.n; t++){
+      log_printf(LOG_ATTEMPT, " %-8llu%s",
+                 (unsigned long long) (b.index[t] + 1), b.plain[t]);
+    }
+    if(batch_match(&b, &set, group, digest, found) > 0){
+      for(t=0; t<b.n; t++){
+        for(f=found[t]; f>=0; f=set.targets[f].next){
+          if(targets_crack(&set, f, b.index[t])){
+            log_printf(LOG_RESULT, "#%-8llu%s %.*s",
+                       (unsigned long long) (b.index[t] + 1), b.plain[t],
+                       set.targets[f].hash_len, set.targets[f].hash);
+            announce_found(f, b.index[t]);
+          }
+        }
       }
+    }
+    meter_hashed(ctx->counts, b.n);
+  }
+  meter_chunk(ctx->counts, 1);
+  log_printf(LOG_PROGRESS, "Rank %d hashed candidates %llu to %llu with %s",
+             rank, (unsigned long long) first, (unsigned long long) last,
+             set.groups[group].setting);
+}
+
+/**
+ A hashing thread: sets itself up and then takes chunks from the queue until
+ there will be no more.
+*/
+
+void *hash_thread(void *arg){
+  int worker = (intptr_t) arg;
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t bytes = (sizeof(thread_context) + page - 1) / page * page;
+  thread_context *ctx;
+  uint32_t item;
+
+  meter_pinned(&metrics.slots[worker],
+               affinity_pin(&placement, first_place + worker));
+  ctx = aligned_alloc(page, bytes);
+  memset(ctx, 0, bytes);
+  scheme_ctx_init(&ctx->scheme);
+  ctx->counts = &metrics.slots[worker];
+  contexts[worker] = ctx;
+
+  for(;;){
+    pthread_mutex_lock(&lock);
+    while(queue_len == 0 && !no_more_work){
+      pthread_cond_wait(&work_ready, &lock);
+    }
+    if(queue_len == 0){
+      running_threads--;
+      pthread_mutex_unlock(&lock);
+      return NULL;
+    }
+    item = queue[queue_head];
+    queue_head = (queue_head + 1) % n_threads;
+    queue_len--;
+    pthread_mutex_unlock(&lock);
+    kernel_function(ctx, item);
+  }
 }
+
+/**
+ Puts a chunk in the queue, or with NO_MORE_WORK lets the threads finish
+ once it is empty.
+*/
+
+void queue_item(uint32_t item){
+  pthread_mutex_lock(&lock);
+  if(item == NO_MORE_WORK){
+    no_more_work = 1;
+    pthread_cond_broadcast(&work_ready);
+  } else {
+    queue[(queue_head + queue_len++) % n_threads] = item;
+    pthread_cond_signal(&work_ready);
+  }
+  pthread_mutex_unlock(&lock);
+}
+
+int queue_space(void){
+  int space;
+
+  pthread_mutex_lock(&lock);
+  space = no_more_work ? 0 : n_threads - queue_len;
+  pthread_mutex_unlock(&lock);
+  return space;
+}
+
+/**
+ Rank 0 fills its own queue straight from the chunks still to be handed out.
+*/
+
+void coordinator_feed(void){
+  int space = queue_space();
+
+  while(space-- > 0){
+    queue_item(next_chunk());
+  }
+}
+
+/**
+ Every other rank asks for a chunk whenever its queue has room and waits for
+ the answer without blocking, so the round trip to the coordinator overlaps
+ with hashing.
+*/
+
+void worker_feed(void){
+  static MPI_Request request;
+  static int waiting = 0;
+  static uint32_t item;
+  static meter_count counts;
+  int flag;
+
+  if(waiting){
+    MPI_Test(&request, &flag, MPI_STATUS_IGNORE);
+    if(!flag){
+      return;
     }
+    waiting = 0;
+    queue_item(item);
   }
-  printf("%d solutions explored\n", count);
+  if(queue_space() > 0){
+    MPI_Irecv(&item, 1, MPI_UINT32_T, 0, TAG_WORK, MPI_COMM_WORLD, &request);
+    meter_total(&metrics, 0, n_threads, &counts);
+    MPI_Send(&counts, METER_WORDS, MPI_UINT64_T, 0, TAG_REQUEST,
+             MPI_COMM_WORLD);
+    waiting = 1;
+  }
+}
+
+/**
+ The main thread of every rank: starts the hashing threads and then looks
+ after communication every millisecond until they have all finished and, on
+ rank 0, every worker has been told there is no more work.
+*/
+
+void run(void){
+  struct timespec pause = {0, 1000000};
+  pthread_t *threads = malloc(n_threads * sizeof(pthread_t));
+  int i, finished;
+
+  next_item = 0;
+  active_workers = rank == 0 ? size - 1 : 0;
+  queue = malloc(n_threads * sizeof(uint32_t));
+  contexts = calloc(n_threads, sizeof(thread_context *));
+  running_threads = n_threads;
+  // Only rank 0 sees all of the counts, so only it reports
+  meter_init(&metrics, rank == 0 ? n_threads + size : n_threads, n_items);
+  if(placement.policy != AFFINITY_NONE){
+    metrics.affinity = affinity_name(placement.policy);
+  }
+  meter_start(&metrics, rank == 0 ? report_interval : 0);
+  for(i=0; i<n_threads; i++){
+    if(pthread_create(&threads[i], NULL, hash_thread,
+                      (void *) (intptr_t) i) != 0){
+      fprintf(stderr, "Rank %d could only start %d of %d threads\n", rank, i,
+              n_threads);
+      break;
+    }
+  }
+  if(i == 0){
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  // The rank carries on with the threads that did start
+  pthread_mutex_lock(&lock);
+  running_threads -= n_threads - i;
+  n_threads = i;
+  pthread_mutex_unlock(&lock);
+
+  do {
+    check_found();
+    if(rank == 0){
+      serve_requests();
+      coordinator_feed();
+    } else {
+      worker_feed();
+    }
+    send_found();
+    pthread_mutex_lock(&lock);
+    finished = running_threads == 0;
+    pthread_mutex_unlock(&lock);
+    if(!finished || active_workers > 0){
+      nanosleep(&pause, NULL);
+    }
+  } while(!finished || active_workers > 0);
+
+  for(i=0; i<n_threads; i++){
+    pthread_join(threads[i], NULL);
+  }
+  send_found();
+  free(threads);
+  free(queue);
 }
 
 
 int time_difference(struct timespec *start, struct timespec *finish,
                     long long int *difference) {
-  long long int ds =  finish->tv_sec - start->tv_sec; 
-  long long int dn =  finish->tv_nsec - start->tv_nsec; 
+  long long int ds =  finish->tv_sec - start->tv_sec;
+  long long int dn =  finish->tv_nsec - start->tv_nsec;
 
   if(dn < 0 ) {
     ds--;
-    dn += 1000000000; 
-  } 
+    dn += 1000000000;
+  }
   *difference = ds * 1000000000 + dn;
   return !(*difference > 0);
 }
 
 int main(int argc, char** argv) {
- struct timespec start, finish;   
+ struct timespec start, finish;
   long long int time_elapsed;
+  int i, opt;
+  char *engine_name = "auto";
+  char *mask_text = "?u?u?d?d?d?d";
+  char *custom[MASK_CUSTOM] = {0};
+  meter_count *counts, *all_counts = NULL, sum;
+  int *all_threads = NULL, *offsets = NULL;
+  int t, provided;
+  MPI_Datatype count_type;
+  MPI_Comm node;
+  int policy = AFFINITY_NONE;
+  uint64_t n_chunks;
 
   clock_gettime(CLOCK_MONOTONIC, &start);
 
- 
-  int size, rank;
-int i;
-
-  MPI_Init(NULL, NULL);
+  // Only the main thread calls MPI
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
   MPI_Comm_size(MPI_COMM_WORLD, &size);
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-  if(size != 3) {
-    if(rank == 0) {
-      printf("This program needs to run on exactly 3 processes\n");
+  if(provided < MPI_THREAD_FUNNELED){
+    if(rank == 0){
+      fprintf(stderr, "This MPI cannot be used from a threaded program\n");
+    }
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+
+  while((opt = getopt(argc, argv, "e:f:t:a:P:M:1:2:3:4:i:j:vq")) != -1){
+    if(opt == 'e'){
+      engine_name = optarg;
+    } else if(opt == 'f'){
+      hash_file = optarg;
+    } else if(opt == 't'){
+      n_threads = atoi(optarg) > 0 ? atoi(optarg) : 1;
+    } else if(opt == 'a'){
+      if((policy = affinity_parse(optarg)) < 0){
+        MPI_Abort(MPI_COMM_WORLD, 1);
+      }
+    } else if(opt == 'P'){
+      markov_file = optarg;
+    } else if(opt == 'M'){
+      mask_text = optarg;
+    } else if(opt >= '1' && opt < '1' + MASK_CUSTOM){
+      custom[opt - '1'] = optarg;
+    } else if(opt == 'i'){
+      report_interval = atoi(optarg);
+    } else if(opt == 'j'){
+      report_file = optarg;
+    } else if(opt == 'v'){
+      log_verbosity++;
+    } else if(opt == 'q'){
+      log_verbosity--;
+    } else {
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+  }
+  engine = sha512mb_select(engine_name);
+  if(engine < 0 || mask_parse(&keyspace, mask_text, custom) != 0){
+    fprintf(stderr, "Rank %d cannot use engine %s or mask %s\n", rank,
+            engine_name, mask_text);
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  keyspace_size = mask_keyspace(&keyspace);
+  if(keyspace_size == UINT64_MAX){
+    if(rank == 0){
+      fprintf(stderr, "%s has too many candidates to count\n", mask_text);
+    }
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  if(affinity_init(&placement, policy) != 0){
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  // Count the threads of the ranks before this one on the same node
+  MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank,
+                      MPI_INFO_NULL, &node);
+  MPI_Exscan(&n_threads, &first_place, 1, MPI_INT, MPI_SUM, node);
+  MPI_Comm_rank(node, &t);
+  if(t == 0){
+    first_place = 0;
+  }
+  MPI_Comm_free(&node);
+  if(markov_file){
+    markov_stats *stats = malloc(sizeof(markov_stats));
+
+    if(markov_train(stats, markov_file) < 0 ||
+       markov_init(&order, &keyspace, stats) != 0){
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    free(stats);
+  }
+
+  if(hash_file){
+    if(targets_load_file(&set, hash_file) < 0){
+      MPI_Abort(MPI_COMM_WORLD, 1);
     }
   } else {
-    if(rank ==0){
+    targets_load(&set, encrypted_passwords, n_passwords);
+  }
+  // Every group gets as many items as the one with the smallest chunks
+  n_chunks = 0;
+  chunk_size = malloc((set.n_groups > 0 ? set.n_groups : 1) *
+                      sizeof(uint32_t));
+  for(i=0; i<set.n_groups; i++){
+    uint64_t n;
 
-      int x;
-    
-      MPI_Send(&x, 1, MPI_INT, 1, 0, MPI_COMM_WORLD);
-      MPI_Send(&x, 1, MPI_INT, 2, 0, MPI_COMM_WORLD);
+    chunk_size[i] = scheme_chunk(set.groups[i].setting, CHUNK,
+                                 SHA512MB_LANES_MAX);
+    n = keyspace_size / chunk_size[i] + (keyspace_size % chunk_size[i] != 0);
+    if(n > n_chunks){
+      n_chunks = n;
+    }
+  }
+  if(n_chunks * set.n_groups >= NO_MORE_WORK){
+    if(rank == 0){
+      fprintf(stderr, "Too many candidates to split into chunks\n");
+    }
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  n_items = n_chunks * set.n_groups;
 
+  found_out = malloc((set.n_targets + 1) * sizeof(*found_out));
+  found_sends = malloc((set.n_targets * (size - 1) + 1) * sizeof(MPI_Request));
+  MPI_Irecv(found_in, 2, MPI_UINT64_T, MPI_ANY_SOURCE, TAG_FOUND,
+            MPI_COMM_WORLD, &found_request);
 
- 
-    } else if(rank==1){
-      int number;
-      MPI_Recv(&number, 1, MPI_INT, 0, 0, MPI_COMM_WORLD, 
-                         MPI_STATUS_IGNORE);
-        for(i=0;i<n_passwords;i<i++) {
-          kernel_function1(encrypted_passwords[i]);
-        }
+  log_open(stdout);
+  run();
+  finish_found();
+  for(i=0; i<n_threads; i++){
+    scheme_ctx_free(&contexts[i]->scheme);
+    free(contexts[i]);
+  }
+
+  // Every thread's counts go to rank 0, whose copies of the other ranks'
+  // totals are only as new as their last request for a chunk
+  counts = malloc(n_threads * sizeof(meter_count));
+  meter_counts(&metrics, 0, n_threads, counts);
+  if(rank == 0){
+    all_threads = malloc(size * sizeof(int));
+    offsets = malloc(size * sizeof(int));
+  }
+  MPI_Gather(&n_threads, 1, MPI_INT, all_threads, 1, MPI_INT, 0,
+             MPI_COMM_WORLD);
+  if(rank == 0){
+    for(i=0; i<size; i++){
+      offsets[i] = i > 0 ? offsets[i - 1] + all_threads[i - 1] : 0;
+    }
+    all_counts = malloc((offsets[size - 1] + all_threads[size - 1]) *
+                        sizeof(meter_count));
+  }
+  MPI_Type_contiguous(METER_WORDS, MPI_UINT64_T, &count_type);
+  MPI_Type_commit(&count_type);
+  MPI_Gatherv(counts, n_threads, count_type, all_counts, all_threads,
+              offsets, count_type, 0, MPI_COMM_WORLD);
+  MPI_Type_free(&count_type);
+  if(rank == 0){
+    for(i=0; i<size; i++){
+      sum.hashed = sum.done = sum.chunks = 0;
+      sum.cpu = -1;
+      for(t=0; t<all_threads[i]; t++){
+        sum.hashed += all_counts[offsets[i] + t].hashed;
+        sum.done += all_counts[offsets[i] + t].done;
+        sum.chunks += all_counts[offsets[i] + t].chunks;
       }
-      else{
-      int number;
-      MPI_Recv(&number, 1, MPI_INT, 0, 0, MPI_COMM_WORLD, 
-                         MPI_STATUS_IGNORE);
-        for(i=0;i<n_passwords;i<i++) {
-          kernel_function2(encrypted_passwords[i]);
-        }
+      if(i > 0){
+        meter_set(&metrics.slots[n_threads + i], &sum);
       }
+      log_printf(LOG_INFO, "%llu solutions explored in %llu chunks by rank %d",
+                 (unsigned long long) sum.hashed,
+                 (unsigned long long) sum.chunks, i);
+    }
+    meter_stop(&metrics);
+    if(report_file){
+      meter_json(report_file, "babupw", metrics.affinity,
+                 meter_seconds(&metrics), size, all_threads, all_counts);
     }
-    MPI_Finalize(); 
+    free(all_threads);
+    free(offsets);
+    free(all_counts);
+    targets_summary(&set);
+  }
+  free(counts);
+  meter_free(&metrics);
+
+  free(found_out);
+  free(found_sends);
+  free(contexts);
+  free(chunk_size);
+  if(markov_file){
+    markov_free(&order);
+  }
+  affinity_free(&placement);
+  targets_free(&set);
+  log_close();
+    MPI_Finalize();
  clock_gettime(CLOCK_MONOTONIC, &finish);
   time_difference(&start, &finish, &time_elapsed);
-  printf("Time elapsed was %lldns or %0.9lfs\n", time_elapsed,
-         (time_elapsed/1.0e9)); 
+  if(rank == 0){
+    printf("Time elapsed was %lldns or %0.9lfs\n", time_elapsed,
+           (time_elapsed/1.0e9));
+  }
 
   return 0;
 }
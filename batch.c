@@ -0,0 +1,47 @@
+#include "batch.h"
+#include "sha512mb.h"
+
+/******************************************************************************
+  Hashing and matching blocks of candidates. See batch.h.
+
+  Link into a cracker with:
+    cc -O2 -o Threadcw Threadcw.c sha512crypt.c sha512mb.c targets.c pool.c \
+       mask.c checkpoint.c wordlist.c scheme.c markov.c log.c meter.c \
+       affinity.c batch.c -pthread -lcrypt -lm
+******************************************************************************/
+
+_Static_assert(BATCH_SIZE % SHA512MB_LANES_MAX == 0,
+               "A block must fill the lanes of every engine");
+
+/**
+ Hashes every candidate of the block with the context's setting, as many at
+ a time as the engine has lanes.
+*/
+
+void batch_hash(const candidate_batch *b, scheme_ctx *c, int engine,
+                unsigned char (*digests)[SHA512CRYPT_DIGEST_LEN]){
+  const char *keys[BATCH_SIZE];
+  int lanes = sha512mb_lanes(engine);
+  int i;
+
+  for(i=0; i<b->n; i++){
+    keys[i] = b->plain[i];
+  }
+  for(i=0; i<b->n; i+=lanes){
+    int n = b->n - i < lanes ? b->n - i : lanes;
+
+    scheme_hash(c, engine, keys + i, b->len, n, digests + i);
+  }
+}
+
+/**
+ Looks the block's digests up in a salt group. found gets the index of the
+ first target each one cracks, or -1; further targets with the same hash
+ are linked through target.next. Returns how many of them crack a target.
+*/
+
+int batch_match(const candidate_batch *b, target_set *set, int group,
+                const unsigned char (*digests)[SHA512CRYPT_DIGEST_LEN],
+                int *found){
+  return targets_find_batch(set, group, digests, b->n, found);
+}
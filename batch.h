@@ -0,0 +1,92 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdint.h>
+#include <string.h>
+#include "sha512crypt.h"
+#include "scheme.h"
+#include "targets.h"
+#include "mask.h"
+#include "markov.h"
+#include "wordlist.h"
+
+/******************************************************************************
+  Blocks of candidates between the generators and the hash engines. A
+  generator fills a block with up to BATCH_SIZE candidates of one length,
+  the engine hashes the whole block into as many digests, and the digests
+  are then all looked up at once. The block is a structure of arrays, the
+  candidates in one array and their numbers in another, so the engines get
+  the keys packed together and nothing else.
+
+  Any generator can feed any engine: masks and Markov ranges fill a block
+  with batch_fill_mask() and batch_fill_markov(), and wordlists, whose words
+  change length, keep a block for each length and add to it with
+  batch_add(). Matching over a whole block lets the lookups of targets.c
+  prefetch their table slots before probing any of them.
+******************************************************************************/
+
+#define BATCH_SIZE    32        // Candidates per block, a multiple of lanes
+#define BATCH_KEY_MAX 64        // Longest candidate, WORD_MAX and MASK_MAX
+
+_Static_assert(BATCH_KEY_MAX >= WORD_MAX && BATCH_KEY_MAX >= MASK_MAX,
+               "A block must hold candidates from any generator");
+
+typedef struct {
+  int n;                        // Candidates in the block
+  int len;                      // The length of every one of them
+  char plain[BATCH_SIZE][BATCH_KEY_MAX + 1];
+  uint64_t index[BATCH_SIZE];   // Each candidate's number
+} candidate_batch;
+
+void batch_hash(const candidate_batch *b, scheme_ctx *c, int engine,
+                unsigned char (*digests)[SHA512CRYPT_DIGEST_LEN]);
+int batch_match(const candidate_batch *b, target_set *set, int group,
+                const unsigned char (*digests)[SHA512CRYPT_DIGEST_LEN],
+                int *found);
+
+static inline void batch_init(candidate_batch *b, int len){
+  b->n = 0;
+  b->len = len;
+}
+
+/**
+ Adds a candidate of the block's length. Returns 1 once the block is full.
+*/
+
+static inline int batch_add(candidate_batch *b, const char *plain,
+                            uint64_t index){
+  memcpy(b->plain[b->n], plain, b->len);
+  b->plain[b->n][b->len] = '\0';
+  b->index[b->n++] = index;
+  return b->n == BATCH_SIZE;
+}
+
+/**
+ Fills the block with the next candidates of a mask range. Returns how many
+ there are, 0 once the range is used up.
+*/
+
+static inline int batch_fill_mask(candidate_batch *b, mask_range *r){
+  batch_init(b, r->it.m->length);
+  while(b->n < BATCH_SIZE &&
+        mask_range_next(r, b->plain[b->n], &b->index[b->n])){
+    b->n++;
+  }
+  return b->n;
+}
+
+/**
+ Fills the block with the next candidates of a Markov range, as
+ batch_fill_mask().
+*/
+
+static inline int batch_fill_markov(candidate_batch *b, markov_range *r){
+  batch_init(b, r->mk->m->length);
+  while(b->n < BATCH_SIZE &&
+        markov_range_next(r, b->plain[b->n], &b->index[b->n])){
+    b->n++;
+  }
+  return b->n;
+}
+
+#endif
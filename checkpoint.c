@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "checkpoint.h"
+
+/******************************************************************************
+  Creating, checking and mapping progress files. See checkpoint.h.
+
+  Link into a cracker with:
+    cc -O2 -o Threadcw Threadcw.c sha512crypt.c sha512mb.c targets.c pool.c \
+       mask.c checkpoint.c wordlist.c scheme.c markov.c log.c meter.c \
+       affinity.c batch.c -pthread -lcrypt -lm
+******************************************************************************/
+
+/**
+ Mixes len characters of text into a job identifier, starting from 0.
+ Anything that changes which candidate a work item or target number means,
+ such as the mask, the chunk size or the list of hashes, should go into it.
+*/
+
+uint64_t checkpoint_job(uint64_t job, const char *text, size_t len){
+  size_t i;
+
+  if(job == 0){
+    job = 14695981039346656037ULL;  // FNV-1a offset basis
+  }
+  for(i=0; i<len; i++){
+    job = (job ^ (unsigned char) text[i]) * 1099511628211ULL;
+  }
+  return (job ^ 0xff) * 1099511628211ULL;  // Separates "ab","c" from "a","bc"
+}
+
+/**
+ Mixes a file into a job identifier: its path, and its size and the time it
+ was last changed, so that a file that has been edited or replaced since a
+ run was interrupted gives a different job rather than a stale bitmap.
+*/
+
+uint64_t checkpoint_job_file(uint64_t job, const char *path){
+  struct stat st;
+  char version[64] = "";
+
+  if(stat(path, &st) == 0){
+    snprintf(version, sizeof(version), "%lld %lld.%09ld",
+             (long long) st.st_size, (long long) st.st_mtim.tv_sec,
+             st.st_mtim.tv_nsec);
+  }
+  job = checkpoint_job(job, path, strlen(path));
+  return checkpoint_job(job, version, strlen(version));
+}
+
+static size_t file_size(uint32_t n_items, uint32_t n_targets){
+  return sizeof(checkpoint_header) + ((n_items + 63) / 64) * sizeof(uint64_t) +
+         n_targets * sizeof(uint64_t);
+}
+
+/**
+ Opens the progress file at path, creating it if it does not exist. Returns
+ 1 if it already held progress for this job, 0 if it is new, and -1 if it
+ cannot be used, for instance because it belongs to a different job.
+*/
+
+int checkpoint_open(checkpoint *cp, const char *path, uint64_t job,
+                    uint32_t n_items, uint32_t n_targets){
+  size_t size = file_size(n_items, n_targets);
+  static const char unset[8];    // The magic of a header never written
+  struct stat st;
+  int fd, resumed;
+  void *map;
+
+  fd = open(path, O_RDWR | O_CREAT, 0644);
+  if(fd < 0 || fstat(fd, &st) != 0){
+    perror(path);
+    if(fd >= 0){
+      close(fd);
+    }
+    return -1;
+  }
+  resumed = st.st_size > 0;
+  if(resumed && (size_t) st.st_size != size){
+    fprintf(stderr, "%s belongs to a different job\n", path);
+    close(fd);
+    return -1;
+  }
+  if(!resumed && ftruncate(fd, size) != 0){
+    perror(path);
+    close(fd);
+    return -1;
+  }
+
+  map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if(map == MAP_FAILED){
+    perror(path);
+    return -1;
+  }
+  cp->header = map;
+  cp->done = (_Atomic uint64_t *) (cp->header + 1);
+  cp->found = cp->done + (n_items + 63) / 64;
+  cp->size = size;
+
+  // A run that stopped before its header was written recorded no progress
+  if(resumed && memcmp(cp->header->magic, unset, 8) == 0){
+    memset(map, 0, size);
+    resumed = 0;
+  }
+  if(resumed){
+    if(memcmp(cp->header->magic, CHECKPOINT_MAGIC, 8) != 0 ||
+       cp->header->job != job || cp->header->n_items != n_items ||
+       cp->header->n_targets != n_targets){
+      fprintf(stderr, "%s belongs to a different job\n", path);
+      munmap(map, size);
+      return -1;
+    }
+  } else {
+    cp->header->job = job;
+    cp->header->n_items = n_items;
+    cp->header->n_targets = n_targets;
+    // The magic goes in last, so a half written header is never trusted
+    memcpy(cp->header->magic, CHECKPOINT_MAGIC, 8);
+  }
+  return resumed;
+}
+
+uint32_t checkpoint_count_done(checkpoint *cp){
+  uint32_t i, n = 0;
+
+  for(i=0; i<(cp->header->n_items + 63) / 64; i++){
+    n += __builtin_popcountll(atomic_load(&cp->done[i]));
+  }
+  return n;
+}
+
+void checkpoint_close(checkpoint *cp){
+  msync(cp->header, cp->size, MS_SYNC);
+  munmap(cp->header, cp->size);
+}
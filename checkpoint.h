@@ -0,0 +1,53 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+/******************************************************************************
+  A progress file for long cracking runs. It holds one bit per work item that
+  has been finished and, for every target, the candidate that cracked it. The
+  file is memory mapped and workers update it with atomic operations, so there
+  is no locking and nothing to flush: if the process dies the kernel still
+  has every completed chunk, and a restart only redoes the chunks that were
+  being worked on at the time.
+******************************************************************************/
+
+#define CHECKPOINT_MAGIC "CRKPT01"
+
+typedef struct {
+  char magic[8];
+  uint64_t job;             // Identifies the mask, chunking and targets
+  uint32_t n_items;
+  uint32_t n_targets;
+} checkpoint_header;
+
+typedef struct {
+  checkpoint_header *header;
+  _Atomic uint64_t *done;   // Bitmap of finished work items
+  _Atomic uint64_t *found;  // Per target: cracking candidate + 1, 0 if not
+  size_t size;
+} checkpoint;
+
+uint64_t checkpoint_job(uint64_t job, const char *text, size_t len);
+uint64_t checkpoint_job_file(uint64_t job, const char *path);
+int checkpoint_open(checkpoint *cp, const char *path, uint64_t job,
+                    uint32_t n_items, uint32_t n_targets);
+uint32_t checkpoint_count_done(checkpoint *cp);
+void checkpoint_close(checkpoint *cp);
+
+static inline int checkpoint_is_done(checkpoint *cp, uint32_t item){
+  return (atomic_load_explicit(&cp->done[item / 64], memory_order_relaxed) >>
+          (item % 64)) & 1;
+}
+
+static inline void checkpoint_mark_done(checkpoint *cp, uint32_t item){
+  atomic_fetch_or(&cp->done[item / 64], (uint64_t) 1 << (item % 64));
+}
+
+static inline void checkpoint_found(checkpoint *cp, int t, uint64_t index){
+  atomic_store(&cp->found[t], index + 1);
+}
+
+#endif
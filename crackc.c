@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "mask.h"
+
+/******************************************************************************
+  A client for crackd, enough to test it with. Sends one job, then prints
+  what the daemon sends back until the job is done.
+
+  Compile with:
+    cc -O2 -o crackc crackc.c
+
+  To crack the course hashes with a priority of 5 and give up after a
+  minute:
+    ./crackc -p 5 -d 60 -M '?1?1?d?d' -1 BEGSVTD -f hashes.txt
+
+  -s names the daemon's socket, crackd.sock by default. -f sends a file of
+  hashes and any further arguments are sent as hashes themselves. -M, -1 to
+  -4, -w and -r are as in Threadcw, and -p and -d give the priority and the
+  deadline in seconds. Files are passed to the daemon as full paths, so it
+  can find them whatever directory it was started in.
+
+  The exit status is 0 if the daemon ran the job to its end, whatever came
+  of it, and 1 if the job was turned down or the connection was lost.
+******************************************************************************/
+
+/**
+ Sends "keyword value" if there is a value. A file is sent as its full path.
+ Returns -1 if it cannot be.
+*/
+
+int send_field(FILE *out, const char *keyword, const char *value, int file){
+  char path[PATH_MAX];
+
+  if(value == NULL){
+    return 0;
+  }
+  if(file){
+    if(realpath(value, path) == NULL){
+      perror(value);
+      return -1;
+    }
+    value = path;
+  }
+  fprintf(out, "%s %s\n", keyword, value);
+  return 0;
+}
+
+int main(int argc, char *argv[]){
+  int opt, i, fd;
+  char *socket_path = "crackd.sock";
+  char *mask_text = NULL;
+  char *custom[MASK_CUSTOM] = {0};
+  char *wordlist_file = NULL;
+  char *rules_file = NULL;
+  char *hash_file = NULL;
+  char *priority = NULL;
+  char *deadline = NULL;
+  struct sockaddr_un addr = {0};
+  char line[1024];
+  int finished = 0;
+  FILE *out, *in;
+
+  while((opt = getopt(argc, argv, "s:p:d:f:w:r:M:1:2:3:4:")) != -1){
+    if(opt == 's'){
+      socket_path = optarg;
+    } else if(opt == 'p'){
+      priority = optarg;
+    } else if(opt == 'd'){
+      deadline = optarg;
+    } else if(opt == 'f'){
+      hash_file = optarg;
+    } else if(opt == 'w'){
+      wordlist_file = optarg;
+    } else if(opt == 'r'){
+      rules_file = optarg;
+    } else if(opt == 'M'){
+      mask_text = optarg;
+    } else if(opt >= '1' && opt < '1' + MASK_CUSTOM){
+      custom[opt - '1'] = optarg;
+    } else {
+      break;
+    }
+  }
+  if(hash_file == NULL && optind == argc){
+    fprintf(stderr, "Usage: %s [-s socket] [-p priority] [-d seconds] "
+            "[-w wordlist [-r rules]] [-M mask] [-1 charset] ... "
+            "[-4 charset] -f hash_file | hash ...\n", argv[0]);
+    return 1;
+  }
+
+  if(strlen(socket_path) >= sizeof(addr.sun_path)){
+    fprintf(stderr, "%s is too long a path for a socket\n", socket_path);
+    return 1;
+  }
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, socket_path);
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(fd < 0 || connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0){
+    perror(socket_path);
+    return 1;
+  }
+  out = fdopen(dup(fd), "w");
+  in = fdopen(fd, "r");
+
+  send_field(out, "priority", priority, 0);
+  send_field(out, "deadline", deadline, 0);
+  send_field(out, "mask", mask_text, 0);
+  for(i=0; i<MASK_CUSTOM; i++){
+    char keyword[16];
+
+    snprintf(keyword, sizeof(keyword), "charset%d", i + 1);
+    send_field(out, keyword, custom[i], 0);
+  }
+  if(send_field(out, "wordlist", wordlist_file, 1) != 0 ||
+     send_field(out, "rules", rules_file, 1) != 0 ||
+     send_field(out, "hashes", hash_file, 1) != 0){
+    return 1;
+  }
+  for(i=optind; i<argc; i++){
+    send_field(out, "hash", argv[i], 0);
+  }
+  fprintf(out, "end\n");
+  fflush(out);
+
+  while(fgets(line, sizeof(line), in)){
+    fputs(line, stdout);
+    fflush(stdout);
+    if(strncmp(line, "done ", 5) == 0){
+      finished = 1;
+    }
+  }
+  fclose(out);
+  fclose(in);
+  return finished ? 0 : 1;
+}
@@ -0,0 +1,998 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "sha512crypt.h"
+#include "sha512mb.h"
+#include "targets.h"
+#include "pool.h"
+#include "mask.h"
+#include "wordlist.h"
+#include "scheme.h"
+#include "log.h"
+#include "affinity.h"
+#include "batch.h"
+
+/******************************************************************************
+  A cracking daemon. Instead of one run of Threadcw per job, each fighting
+  the others for the cores, crackd stays up with one pool of threads and
+  takes jobs from any number of clients over a Unix domain socket, sharing
+  the threads out between them.
+
+  Compile with:
+    cc -O2 -o crackd crackd.c sha512crypt.c sha512mb.c targets.c pool.c \
+       mask.c wordlist.c scheme.c log.c affinity.c batch.c -pthread -lcrypt -lm
+
+  Start it with:
+    ./crackd -s crackd.sock &
+
+  and send it jobs with crackc, see crackc.c. -t, -e and -a set the threads,
+  the SHA-512-crypt kernel and how threads are pinned, as in Threadcw. The
+  socket is only open to the user the daemon runs as, as the daemon reads
+  whatever hash files and wordlists a job names with its own rights.
+
+  A job is one connection. The client sends lines of the form "keyword
+  value" and then "end":
+
+    hash H          a hash to crack, as often as there are hashes
+    hashes FILE     or a file of them, one per line or as /etc/shadow
+    mask M          the mask to try, ?u?u?d?d by default
+    charset1 S      the custom charsets ?1 to ?4 of the mask
+    wordlist FILE   try the words in FILE instead of a mask
+    rules FILE      with these rules rather than the built-in ones
+    priority N      1 to 100, 1 by default: the job's share of the threads
+    deadline S      give up S seconds after the job was queued
+
+  The daemon answers "queued ID" or "error WHY", then sends a line for each
+  password as it is found and one last line when the job stops:
+
+    found ID HASH PASSWORD
+    done ID finished|cracked|expired|stopped CRACKED/TARGETS CANDIDATES SECONDS
+
+  where finished means the whole keyspace was tried, cracked that every
+  target was found and stopped that the daemon was shut down. A client that
+  hangs up cancels its job.
+
+  One thread serves every connection, so it never does anything slow: the
+  hash file, wordlist and rules of a job are loaded by a thread of the pool,
+  and lines for a client are queued, to be sent as fast as the client reads
+  them, at most POLL_MS after they are queued. A client that is slow to
+  read holds nobody up and still gets every line.
+
+  Jobs are split into chunks as in Threadcw, and threads take one chunk at a
+  time from whichever job is furthest behind its share. That is stride
+  scheduling: handing a job a chunk moves it on by STRIDE / priority, so a
+  job of priority 4 gets 4 chunks for every one that a job of priority 1
+  gets, and a new job starts level with the others rather than with a
+  backlog of turns. Between jobs that are level, the one with the nearest
+  deadline goes first.
+******************************************************************************/
+
+#define CHUNK      200          // Candidates per chunk, a multiple of 8 lanes
+#define WORD_CHUNK 256          // Bytes of wordlist per chunk
+#define STRIDE     (1 << 20)    // How far a chunk moves a priority 1 job on
+#define PRIORITY_MAX 100
+#define JOB_LINE   1024         // Longest line a client can send
+#define POLL_MS    100          // How often deadlines are checked
+
+typedef struct job {
+  struct job *next;
+  int id;
+  int fd;                       // The client's connection
+  char in[JOB_LINE];            // What has been read of the current line
+  size_t in_len;
+
+  // What the client asked for, until the job is queued
+  char *mask_text;
+  char *custom[MASK_CUSTOM];
+  char *wordlist_file;
+  char *rules_file;
+  char *hash_file;
+  char **hashes;
+  int n_hashes;
+  int priority;
+  double deadline;              // Seconds, or 0 for none
+
+  // Read-only once the job is queued
+  mask keyspace;
+  uint64_t size;                // Candidates, or bytes of wordlist
+  wordlist words;
+  rule *rules;
+  int n_rules;
+  target_set set;
+  uint32_t *chunk_size;         // Candidates, or bytes, per chunk by group
+  uint32_t n_items;
+  struct timespec queued;
+
+  // Scheduling and output, under lock
+  int ended;                    // Set once the client has sent "end"
+  int loading;                  // Set once a thread has taken on loading it
+  int submitted;                // Set once the job has been queued
+  uint64_t pass;                // How far through its turns the job is
+  uint32_t next_item;           // The next chunk to hand out
+  int in_flight;                // Chunks that threads are working on
+  uint64_t hashed;              // Candidates tried so far
+  const char *outcome;          // Why the job stopped, or NULL
+  int reported;                 // Set once the last line has been sent
+  int closed;                   // Set once the client has hung up
+  int shut;                     // Set once the connection is shut for writes
+  char *out;                    // Lines waiting to go to the client
+  size_t out_len;
+  size_t out_size;
+} job;
+
+/**
+ What each thread keeps from one chunk to the next, allocated by the thread
+ after it is pinned, as in Threadcw.
+*/
+
+typedef struct {
+  _Alignas(64) scheme_ctx scheme; // Set up for the group being hashed
+  int job;                      // The job the scheme was set up for
+  candidate_batch batch[WORD_MAX + 1]; // Mangled words, by length
+} worker_context;
+
+pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER; // Guards the job list
+pthread_cond_t work = PTHREAD_COND_INITIALIZER;   // Signalled for new jobs
+job *jobs;              // Every connection, queued or not
+uint64_t vtime;         // The pass of the job that last had a chunk
+int quitting;           // Set when the threads are to finish
+int next_id = 1;
+int engine;             // Which SHA-512-crypt kernel to hash with
+affinity placement;     // Which CPU each thread is pinned to, with -a
+volatile sig_atomic_t stop_signal;
+
+double seconds_since(const struct timespec *since){
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - since->tv_sec) +
+         (now.tv_nsec - since->tv_nsec) / 1.0e9;
+}
+
+/**
+ Queues one line for the client. Lines are added whole under lock, so that
+ lines from different threads are never mixed.
+*/
+
+void job_send(job *j, const char *format, ...){
+  char line[JOB_LINE];
+  va_list args;
+  int n;
+
+  va_start(args, format);
+  n = vsnprintf(line, sizeof(line) - 1, format, args);
+  va_end(args);
+  if(n < 0 || j->closed){
+    return;
+  }
+  if(n > (int) sizeof(line) - 2){
+    n = sizeof(line) - 2;
+  }
+  line[n++] = '\n';
+  if(j->out_len + n > j->out_size){
+    char *out = realloc(j->out, 2 * (j->out_len + n));
+
+    if(out == NULL){
+      // A client whose lines cannot be kept is dropped, as if it had hung up
+      log_printf(LOG_INFO, "Job %d dropped: out of memory", j->id);
+      if(j->ended && !j->outcome){
+        j->outcome = "cancelled";
+      }
+      j->closed = 1;
+      return;
+    }
+    j->out = out;
+    j->out_size = 2 * (j->out_len + n);
+  }
+  memcpy(j->out + j->out_len, line, n);
+  j->out_len += n;
+}
+
+/**
+ Sends as much of the queued output as the client will take without
+ waiting, and shuts the connection for writes once the last line has gone.
+ Called under lock.
+*/
+
+void job_flush(job *j){
+  while(j->out_len > 0 && !j->closed){
+    ssize_t n = send(j->fd, j->out, j->out_len, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+    if(n < 0 && errno == EINTR){
+      continue;
+    }
+    if(n < 0){
+      // Unless it is only full, the connection is gone, as job_read() will
+      // find out
+      if(errno != EAGAIN && errno != EWOULDBLOCK){
+        j->out_len = 0;
+      }
+      break;
+    }
+    memmove(j->out, j->out + n, j->out_len - n);
+    j->out_len -= n;
+  }
+  if(j->reported && j->out_len == 0 && !j->shut){
+    shutdown(j->fd, SHUT_WR);
+    j->shut = 1;
+  }
+}
+
+/**
+ Turns a job down with the reason why. Called under lock.
+*/
+
+void job_reject(job *j, const char *why){
+  job_send(j, "error %s", why);
+  j->outcome = "rejected";
+  j->reported = 1;
+  log_printf(LOG_INFO, "Job %d turned down: %s", j->id, why);
+}
+
+/**
+ Works out which group and which candidates, or bytes of wordlist, an item
+ covers, as Threadcw does. Returns 0 if there is nothing to do for it.
+*/
+
+int item_range(job *j, uint32_t item, int *group, uint64_t *first,
+               uint64_t *last){
+  uint64_t chunk;
+
+  *group = item % j->set.n_groups;
+  chunk = j->chunk_size[*group];
+  *first = (uint64_t) (item / j->set.n_groups) * chunk;
+  *last = j->size - *first > chunk ? *first + chunk : j->size;
+  return *first < j->size && group_remaining(&j->set, *group) > 0;
+}
+
+/**
+ Gives a job its outcome once it has run out of targets or of chunks.
+ Called under lock.
+*/
+
+void settle(job *j){
+  if(j->outcome){
+    return;
+  }
+  if(targets_remaining(&j->set) == 0){
+    j->outcome = "cracked";
+  } else if(j->next_item == j->n_items && j->in_flight == 0){
+    j->outcome = "finished";
+  }
+}
+
+int expired(job *j){
+  return j->deadline > 0 && seconds_since(&j->queued) >= j->deadline;
+}
+
+/**
+ Whether job a should have a chunk before job b: the one further behind
+ its share first, then the nearer deadline, then the older job.
+*/
+
+int ahead(const job *a, const job *b){
+  double da = a->deadline > 0 ? a->deadline - seconds_since(&a->queued) : 0;
+  double db = b->deadline > 0 ? b->deadline - seconds_since(&b->queued) : 0;
+
+  if(a->pass != b->pass){
+    return a->pass < b->pass;
+  }
+  if((a->deadline > 0) != (b->deadline > 0)){
+    return a->deadline > 0;
+  }
+  if(da != db){
+    return da < db;
+  }
+  return a->id < b->id;
+}
+
+/**
+ Picks the job that gets the next chunk and takes the chunk, passing over
+ any that there is nothing to do for. Returns NULL if no job has a chunk
+ to give. Called under lock.
+*/
+
+job *pick(uint32_t *item){
+  job *j, *best = NULL;
+  uint64_t first, last;
+  int group;
+
+  for(j=jobs; j; j=j->next){
+    if(!j->submitted || j->outcome){
+      continue;
+    }
+    if(expired(j)){
+      j->outcome = "expired";
+      continue;
+    }
+    while(j->next_item < j->n_items &&
+          !item_range(j, j->next_item, &group, &first, &last)){
+      j->next_item++;
+    }
+    if(j->next_item == j->n_items){
+      settle(j);
+      continue;
+    }
+    if(best == NULL || ahead(j, best)){
+      best = j;
+    }
+  }
+  if(best){
+    *item = best->next_item++;
+    best->in_flight++;
+    vtime = best->pass;
+    best->pass += STRIDE / best->priority;
+  }
+  return best;
+}
+
+/**
+ Looks up a block's digests and sends the client the passwords they crack.
+*/
+
+void check_batch(job *j, int group, const candidate_batch *b,
+                 const unsigned char (*digest)[SHA512CRYPT_DIGEST_LEN]){
+  int found[BATCH_SIZE];
+  int t, f;
+
+  if(batch_match(b, &j->set, group, digest, found) == 0){
+    return;
+  }
+  for(t=0; t<b->n; t++){
+    for(f=found[t]; f>=0; f=j->set.targets[f].next){
+      if(targets_crack(&j->set, f, b->index[t])){
+        target *hit = &j->set.targets[f];
+
+        pthread_mutex_lock(&lock);
+        job_send(j, "found %d %.*s %s", j->id, hit->hash_len, hit->hash,
+                 b->plain[t]);
+        pthread_mutex_unlock(&lock);
+        log_printf(LOG_RESULT, "Job %d: %s %.*s", j->id, b->plain[t],
+                   hit->hash_len, hit->hash);
+      }
+    }
+  }
+}
+
+void hash_batch(worker_context *ctx, job *j, int group, candidate_batch *b){
+  unsigned char digest[BATCH_SIZE][SHA512CRYPT_DIGEST_LEN];
+
+  batch_hash(b, &ctx->scheme, engine, digest);
+  check_batch(j, group, b, digest);
+}
+
+/**
+ Tries one chunk of a job. Returns how many candidates were hashed.
+*/
+
+uint64_t run_item(worker_context *ctx, job *j, uint32_t item){
+  candidate_batch *batch = ctx->batch;
+  uint64_t first, last, hashed = 0;
+  int group, n;
+
+  if(!item_range(j, item, &group, &first, &last)){
+    return 0;
+  }
+  // A new job's settings may be where a finished job's were
+  if(ctx->job != j->id){
+    ctx->scheme.setting = NULL;
+    ctx->job = j->id;
+  }
+  scheme_ctx_set(&ctx->scheme, j->set.groups[group].setting);
+
+  if(j->wordlist_file){
+    char plain[WORD_MAX + 1];
+    const char *p, *end, *word;
+    int len, r;
+
+    for(n=0; n<=WORD_MAX; n++){
+      batch_init(&batch[n], n);
+    }
+    p = wordlist_range(&j->words, first, last, &end);
+    while(p < end && group_remaining(&j->set, group) > 0){
+      uint64_t offset = p - j->words.map;
+
+      p = wordlist_next(&j->words, p, &word, &len);
+      if(len <= 0){
+        continue;
+      }
+      for(r=0; r<j->n_rules; r++){
+        n = rule_apply(&j->rules[r], word, len, plain);
+        if(n >= 0 && batch_add(&batch[n], plain, offset * j->n_rules + r)){
+          hash_batch(ctx, j, group, &batch[n]);
+          hashed += batch[n].n;
+          batch[n].n = 0;
+        }
+      }
+    }
+    for(n=1; n<=WORD_MAX; n++){
+      if(batch[n].n > 0){
+        hash_batch(ctx, j, group, &batch[n]);
+        hashed += batch[n].n;
+      }
+    }
+  } else {
+    mask_range range;
+
+    mask_range_init(&range, &j->keyspace, first, last);
+    while(group_remaining(&j->set, group) > 0 &&
+          batch_fill_mask(&batch[0], &range) > 0){
+      hash_batch(ctx, j, group, &batch[0]);
+      hashed += batch[0].n;
+    }
+  }
+  log_printf(LOG_PROGRESS, "Job %d: %llu to %llu with %s", j->id,
+             (unsigned long long) first, (unsigned long long) last,
+             j->set.groups[group].setting);
+  return hashed;
+}
+
+/**
+ Loads what a job needs and splits it into chunks. Returns NULL, or what is
+ wrong with the job.
+*/
+
+const char *job_setup(job *j){
+  uint64_t n_chunks = 0;
+  int i;
+
+  if(mask_parse(&j->keyspace, j->mask_text ? j->mask_text : "?u?u?d?d",
+                j->custom) != 0){
+    return "bad mask";
+  }
+  if(j->wordlist_file){
+    if(wordlist_open(&j->words, j->wordlist_file) != 0){
+      return "cannot read the wordlist";
+    }
+    j->n_rules = j->rules_file ? rules_load(&j->rules, j->rules_file) :
+                                 rules_default(&j->rules);
+    if(j->n_rules <= 0){
+      return "no rules to apply";
+    }
+    j->size = j->words.size;
+  } else {
+    j->size = mask_keyspace(&j->keyspace);
+    if(j->size == UINT64_MAX){
+      return "too many candidates to count";
+    }
+  }
+
+  if(j->hash_file && j->n_hashes > 0){
+    return "both hash and hashes";
+  }
+  if(j->hash_file ? targets_load_file(&j->set, j->hash_file) <= 0 :
+                    targets_load(&j->set, j->hashes, j->n_hashes) <= 0){
+    return "no targets";
+  }
+  j->chunk_size = malloc(j->set.n_groups * sizeof(uint32_t));
+  for(i=0; i<j->set.n_groups; i++){
+    uint64_t n;
+
+    j->chunk_size[i] = j->wordlist_file ?
+      scheme_chunk(j->set.groups[i].setting, WORD_CHUNK, 1) :
+      scheme_chunk(j->set.groups[i].setting, CHUNK, SHA512MB_LANES_MAX);
+    n = j->size / j->chunk_size[i] + (j->size % j->chunk_size[i] != 0);
+    if(n > n_chunks){
+      n_chunks = n;
+    }
+  }
+  if(n_chunks * j->set.n_groups > UINT32_MAX){
+    return "too many candidates to split into chunks";
+  }
+  j->n_items = n_chunks * j->set.n_groups;
+  return NULL;
+}
+
+/**
+ Queues a job that a thread has loaded, or turns it down. Called under
+ lock.
+*/
+
+void job_queue(job *j, const char *why){
+  if(why){
+    job_reject(j, why);
+    return;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &j->queued);
+  j->pass = vtime;
+  j->submitted = 1;
+  job_send(j, "queued %d", j->id);
+  log_printf(LOG_INFO, "Job %d queued: %d targets, %llu %s, priority %d",
+             j->id, j->set.n_targets, (unsigned long long) j->size,
+             j->wordlist_file ? "bytes of wordlist" : "candidates",
+             j->priority);
+  pthread_cond_broadcast(&work);
+}
+
+/**
+ Takes on loading a job whose client has sent "end", if there is one.
+ Called under lock.
+*/
+
+job *pick_loading(void){
+  job *j;
+
+  for(j=jobs; j; j=j->next){
+    if(j->ended && !j->loading && !j->closed){
+      j->loading = 1;
+      j->in_flight++;
+      return j;
+    }
+  }
+  return NULL;
+}
+
+/**
+ The threads of the pool. Each loads any job that is waiting to be loaded,
+ or else takes a chunk from whichever job pick() chooses, and does the work
+ without holding the lock.
+*/
+
+void *worker_main(void *arg){
+  int worker = (int) (intptr_t) arg;
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t size = (sizeof(worker_context) + page - 1) / page * page;
+  worker_context *ctx;
+  uint32_t item;
+  uint64_t hashed = 0;
+  const char *why = NULL;
+  int loading;
+  job *j;
+
+  affinity_pin(&placement, worker);
+  ctx = aligned_alloc(page, size);
+  memset(ctx, 0, size);
+  scheme_ctx_init(&ctx->scheme);
+
+  pthread_mutex_lock(&lock);
+  for(;;){
+    j = NULL;
+    while(!quitting && (j = pick_loading()) == NULL &&
+          (j = pick(&item)) == NULL){
+      pthread_cond_wait(&work, &lock);
+    }
+    if(j == NULL){
+      break;
+    }
+    loading = !j->submitted;
+    pthread_mutex_unlock(&lock);
+    if(loading){
+      why = job_setup(j);
+    } else {
+      hashed = run_item(ctx, j, item);
+    }
+    pthread_mutex_lock(&lock);
+    j->in_flight--;
+    if(loading){
+      job_queue(j, why);
+    } else {
+      j->hashed += hashed;
+      settle(j);
+    }
+  }
+  pthread_mutex_unlock(&lock);
+
+  scheme_ctx_free(&ctx->scheme);
+  free(ctx);
+  return NULL;
+}
+
+/**
+ Hands a job to the pool to be loaded, once the client has sent "end".
+*/
+
+void job_submit(job *j){
+  pthread_mutex_lock(&lock);
+  j->ended = 1;
+  pthread_cond_signal(&work);
+  pthread_mutex_unlock(&lock);
+}
+
+/**
+ Takes in one line of a job. Returns -1 if the line is not understood.
+*/
+
+int job_line(job *j, char *line){
+  char *value = strchr(line, ' ');
+  char **field = NULL;
+
+  if(value){
+    *value++ = '\0';
+  }
+  if(strcmp(line, "end") == 0){
+    job_submit(j);
+    return 0;
+  }
+  if(value == NULL){
+    return -1;
+  }
+  if(strcmp(line, "hash") == 0){
+    j->hashes = realloc(j->hashes, (j->n_hashes + 1) * sizeof(char *));
+    j->hashes[j->n_hashes++] = strdup(value);
+    return 0;
+  }
+  if(strcmp(line, "priority") == 0){
+    j->priority = atoi(value);
+    return j->priority >= 1 && j->priority <= PRIORITY_MAX ? 0 : -1;
+  }
+  if(strcmp(line, "deadline") == 0){
+    j->deadline = atof(value);
+    return j->deadline > 0 ? 0 : -1;
+  }
+  if(strcmp(line, "mask") == 0){
+    field = &j->mask_text;
+  } else if(strcmp(line, "wordlist") == 0){
+    field = &j->wordlist_file;
+  } else if(strcmp(line, "rules") == 0){
+    field = &j->rules_file;
+  } else if(strcmp(line, "hashes") == 0){
+    field = &j->hash_file;
+  } else if(strncmp(line, "charset", 7) == 0 && line[7] >= '1' &&
+            line[7] < '1' + MASK_CUSTOM && line[8] == '\0'){
+    field = &j->custom[line[7] - '1'];
+  } else {
+    return -1;
+  }
+  free(*field);
+  *field = strdup(value);
+  return 0;
+}
+
+/**
+ Reads what the client has sent. Returns -1 once the client has hung up.
+*/
+
+int job_read(job *j){
+  char buf[JOB_LINE];
+  ssize_t n = read(j->fd, buf, sizeof(buf));
+  ssize_t i;
+
+  if(n <= 0){
+    return n < 0 && errno == EINTR ? 0 : -1;
+  }
+  for(i=0; i<n; i++){
+    // Anything after "end" is ignored
+    if(j->ended || j->reported){
+      break;
+    }
+    if(buf[i] == '\r'){
+      continue;
+    }
+    if(buf[i] != '\n'){
+      if(j->in_len < sizeof(j->in) - 1){
+        j->in[j->in_len++] = buf[i];
+      }
+      continue;
+    }
+    j->in[j->in_len] = '\0';
+    j->in_len = 0;
+    if(job_line(j, j->in) != 0){
+      char why[JOB_LINE + 32];
+
+      snprintf(why, sizeof(why), "cannot make sense of %s", j->in);
+      pthread_mutex_lock(&lock);
+      job_reject(j, why);
+      pthread_mutex_unlock(&lock);
+    }
+  }
+  return 0;
+}
+
+void job_free(job *j){
+  int i;
+
+  targets_free(&j->set);
+  wordlist_close(&j->words);
+  free(j->rules);
+  free(j->chunk_size);
+  free(j->mask_text);
+  for(i=0; i<MASK_CUSTOM; i++){
+    free(j->custom[i]);
+  }
+  free(j->wordlist_file);
+  free(j->rules_file);
+  free(j->hash_file);
+  for(i=0; i<j->n_hashes; i++){
+    free(j->hashes[i]);
+  }
+  free(j->hashes);
+  free(j->out);
+  close(j->fd);
+  free(j);
+}
+
+/**
+ Queues the last line of every job that has stopped and that no thread is
+ still working on, sends what output the clients will take and frees the
+ jobs whose clients have gone. Expires jobs that are past their deadline
+ even when no thread is free to notice.
+*/
+
+void reap(void){
+  job **link, *j, *gone = NULL;
+
+  pthread_mutex_lock(&lock);
+  for(link=&jobs; (j = *link) != NULL; ){
+    if(j->submitted && !j->outcome && (quitting || expired(j))){
+      j->outcome = quitting ? "stopped" : "expired";
+    }
+    if(j->submitted && j->outcome && j->in_flight == 0 && !j->reported){
+      int cracked = j->set.n_targets - targets_remaining(&j->set);
+      double seconds = seconds_since(&j->queued);
+
+      job_send(j, "done %d %s %d/%d %llu %.3f", j->id, j->outcome, cracked,
+               j->set.n_targets, (unsigned long long) j->hashed, seconds);
+      log_printf(LOG_INFO, "Job %d %s: %d of %d targets cracked, %llu "
+                 "candidates in %.3fs", j->id, j->outcome, cracked,
+                 j->set.n_targets, (unsigned long long) j->hashed, seconds);
+      j->reported = 1;
+    }
+    job_flush(j);
+    if(j->closed && j->in_flight == 0){
+      *link = j->next;
+      j->next = gone;
+      gone = j;
+    } else {
+      link = &j->next;
+    }
+  }
+  pthread_mutex_unlock(&lock);
+
+  while(gone){
+    j = gone;
+    gone = j->next;
+    job_free(j);
+  }
+}
+
+/**
+ Marks a job whose client has hung up. Its chunks in flight finish first.
+*/
+
+void job_close(job *j){
+  pthread_mutex_lock(&lock);
+  if(j->ended && !j->outcome){
+    j->outcome = "cancelled";
+  }
+  j->closed = 1;
+  pthread_mutex_unlock(&lock);
+}
+
+void job_accept(int listener){
+  int fd = accept(listener, NULL, NULL);
+  job *j;
+
+  if(fd < 0){
+    return;
+  }
+  j = calloc(1, sizeof(job));
+  j->fd = fd;
+  j->id = next_id++;
+  j->priority = 1;
+  pthread_mutex_lock(&lock);
+  j->next = jobs;
+  jobs = j;
+  pthread_mutex_unlock(&lock);
+}
+
+/**
+ Removes a socket left behind by a daemon that is no longer running.
+ Returns -1, leaving the path alone, if it is anything but a socket or a
+ daemon still answers on it.
+*/
+
+int clear_socket(const struct sockaddr_un *addr){
+  struct stat st;
+  int fd, answered;
+
+  if(lstat(addr->sun_path, &st) != 0){
+    return errno == ENOENT ? 0 : -1;
+  }
+  if(!S_ISSOCK(st.st_mode)){
+    fprintf(stderr, "%s is there already and is not a socket\n",
+            addr->sun_path);
+    return -1;
+  }
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(fd < 0){
+    return -1;
+  }
+  answered = connect(fd, (const struct sockaddr *) addr, sizeof(*addr)) == 0;
+  close(fd);
+  if(answered){
+    fprintf(stderr, "A daemon is already listening on %s\n", addr->sun_path);
+    return -1;
+  }
+  return unlink(addr->sun_path);
+}
+
+int open_socket(const char *path){
+  struct sockaddr_un addr = {0};
+  mode_t mask;
+  int fd, bound;
+
+  if(strlen(path) >= sizeof(addr.sun_path)){
+    fprintf(stderr, "%s is too long a path for a socket\n", path);
+    return -1;
+  }
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(fd < 0){
+    perror("socket");
+    return -1;
+  }
+  if(clear_socket(&addr) != 0){
+    close(fd);
+    return -1;
+  }
+  // Created without group or other access, so it is never open to them
+  mask = umask(077);
+  bound = bind(fd, (struct sockaddr *) &addr, sizeof(addr));
+  umask(mask);
+  if(bound != 0 || listen(fd, 16) != 0){
+    perror(path);
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+void on_signal(int sig){
+  stop_signal = sig;
+}
+
+/**
+ Serves clients until SIGINT or SIGTERM. Only this thread adds jobs to the
+ list or takes them off it, so it can walk the list without the lock.
+*/
+
+void serve(int listener){
+  struct pollfd *fds = NULL;
+  job **polled = NULL;
+  int size = 0, n, i;
+  job *j;
+
+  while(!stop_signal){
+    n = 1;
+    for(j=jobs; j; j=j->next){
+      n += !j->closed;
+    }
+    if(n > size){
+      size = 2 * n;
+      fds = realloc(fds, size * sizeof(struct pollfd));
+      polled = realloc(polled, size * sizeof(job *));
+    }
+    fds[0].fd = listener;
+    fds[0].events = POLLIN;
+    n = 1;
+    pthread_mutex_lock(&lock);
+    for(j=jobs; j; j=j->next){
+      if(!j->closed){
+        fds[n].fd = j->fd;
+        fds[n].events = POLLIN | (j->out_len > 0 ? POLLOUT : 0);
+        polled[n++] = j;
+      }
+    }
+    pthread_mutex_unlock(&lock);
+
+    // Output is sent by reap(), which follows whatever woke poll() up
+    if(poll(fds, n, POLL_MS) > 0){
+      for(i=1; i<n; i++){
+        if((fds[i].revents & ~POLLOUT) && job_read(polled[i]) != 0){
+          job_close(polled[i]);
+        }
+      }
+      if(fds[0].revents & POLLIN){
+        job_accept(listener);
+      }
+    }
+    reap();
+  }
+  free(fds);
+  free(polled);
+}
+
+int main(int argc, char *argv[]){
+  int opt, i, started;
+  int n_threads = pool_default_workers();
+  char *engine_name = "auto";
+  char *socket_path = "crackd.sock";
+  int policy = AFFINITY_NONE;
+  pthread_t *threads;
+  struct sigaction action = {0};
+  int listener;
+  job *j;
+
+  while((opt = getopt(argc, argv, "s:e:t:a:vq")) != -1){
+    if(opt == 's'){
+      socket_path = optarg;
+    } else if(opt == 'e'){
+      engine_name = optarg;
+    } else if(opt == 't'){
+      n_threads = atoi(optarg) > 0 ? atoi(optarg) : 1;
+    } else if(opt == 'a'){
+      if((policy = affinity_parse(optarg)) < 0){
+        return 1;
+      }
+    } else if(opt == 'v'){
+      log_verbosity++;
+    } else if(opt == 'q'){
+      log_verbosity--;
+    } else {
+      fprintf(stderr, "Usage: %s [-s socket] [-e auto|scalar|avx2|avx512] "
+              "[-t threads] [-a compact|scatter|cores] [-v | -q]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  engine = sha512mb_select(engine_name);
+  if(engine < 0){
+    fprintf(stderr, "Engine %s is not available on this CPU\n", engine_name);
+    return 1;
+  }
+  if(affinity_init(&placement, policy) != 0){
+    return 1;
+  }
+  listener = open_socket(socket_path);
+  if(listener < 0){
+    return 1;
+  }
+  action.sa_handler = on_signal;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  log_open(stdout);
+  threads = malloc(n_threads * sizeof(pthread_t));
+  for(started=0; started<n_threads; started++){
+    if(pthread_create(&threads[started], NULL, worker_main,
+                      (void *) (intptr_t) started) != 0){
+      fprintf(stderr, "Could only start %d of %d threads\n", started,
+              n_threads);
+      break;
+    }
+  }
+  if(started == 0){
+    log_close();
+    close(listener);
+    unlink(socket_path);
+    return 1;
+  }
+  log_printf(LOG_INFO, "Listening on %s with %d threads", socket_path,
+             started);
+
+  serve(listener);
+
+  pthread_mutex_lock(&lock);
+  quitting = 1;
+  pthread_cond_broadcast(&work);
+  pthread_mutex_unlock(&lock);
+  for(i=0; i<started; i++){
+    pthread_join(threads[i], NULL);
+  }
+  reap();
+  log_printf(LOG_INFO, "Shutting down");
+  log_close();
+
+  while((j = jobs) != NULL){
+    jobs = j->next;
+    job_free(j);
+  }
+  close(listener);
+  unlink(socket_path);
+  free(threads);
+  affinity_free(&placement);
+  return 0;
+}
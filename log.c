@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include "log.h"
+
+/******************************************************************************
+  The log ring and its writer thread. See log.h.
+
+  The ring is a bounded queue after Dmitry Vyukov's: each slot holds a
+  sequence number that says whether it is free for the producer whose turn
+  it is or full for the writer. A producer claims a slot with one compare
+  and swap on head, formats into it and then publishes it by bumping its
+  sequence number, so producers never wait for each other's formatting.
+
+  Link into a cracker with:
+    cc -O2 -o Threadcw Threadcw.c sha512crypt.c sha512mb.c targets.c pool.c \
+       mask.c checkpoint.c wordlist.c scheme.c markov.c log.c meter.c \
+       affinity.c batch.c -pthread -lcrypt -lm
+******************************************************************************/
+
+#define OUTPUT_SIZE (1 << 20)   // Bytes the writer buffers between flushes
+
+int log_verbosity = LOG_INFO;
+
+static log_slot *slots;         // NULL when there is no writer
+static _Alignas(64) _Atomic uint64_t head;  // The next slot to claim
+static _Alignas(64) uint64_t tail;          // The next slot to write out
+static _Atomic int stopping;
+static _Atomic uint64_t dropped;
+static FILE *output;
+static pthread_t writer;
+
+/**
+ The writer thread: copies lines out in the order they were claimed, and
+ flushes whenever it catches up. Once log_close() has been called it drains
+ the ring and returns.
+*/
+
+static void *write_lines(void *arg){
+  struct timespec pause = {0, 1000000};
+  int unflushed = 0;
+
+  for(;;){
+    log_slot *slot = &slots[tail & (LOG_SLOTS - 1)];
+
+    if(atomic_load_explicit(&slot->seq, memory_order_acquire) == tail + 1){
+      fputs(slot->text, output);
+      atomic_store_explicit(&slot->seq, tail + LOG_SLOTS,
+                            memory_order_release);
+      tail++;
+      unflushed = 1;
+      continue;
+    }
+    if(unflushed){
+      fflush(output);
+      unflushed = 0;
+    }
+    // A line that has been claimed but not yet written is still to come
+    if(atomic_load(&stopping) && atomic_load(&head) == tail){
+      return NULL;
+    }
+    nanosleep(&pause, NULL);
+  }
+}
+
+/**
+ Starts the writer thread, which writes to out from then on. As it sets out's
+ buffer, it has to be called before anything is written to out. If the thread
+ cannot be started, lines go on being written straight out.
+*/
+
+void log_open(FILE *out){
+  uint64_t i;
+
+  output = out;
+  slots = aligned_alloc(_Alignof(log_slot), LOG_SLOTS * sizeof(log_slot));
+  for(i=0; i<LOG_SLOTS; i++){
+    atomic_init(&slots[i].seq, i);
+  }
+  atomic_init(&head, 0);
+  tail = 0;
+  atomic_init(&stopping, 0);
+  atomic_init(&dropped, 0);
+  if(pthread_create(&writer, NULL, write_lines, NULL) != 0){
+    free(slots);
+    slots = NULL;
+    return;
+  }
+  setvbuf(output, NULL, _IOFBF, OUTPUT_SIZE);
+}
+
+/**
+ Logs a line at level, adding the newline. Safe to call from any number of
+ threads at once.
+*/
+
+void log_printf(int level, const char *format, ...){
+  uint64_t pos;
+  log_slot *slot;
+  va_list args;
+  int len;
+
+  if(!log_enabled(level)){
+    return;
+  }
+  va_start(args, format);
+  if(slots == NULL){
+    vprintf(format, args);
+    putchar('\n');
+    va_end(args);
+    return;
+  }
+
+  pos = atomic_load_explicit(&head, memory_order_relaxed);
+  for(;;){
+    int64_t diff;
+
+    slot = &slots[pos & (LOG_SLOTS - 1)];
+    diff = (int64_t) (atomic_load_explicit(&slot->seq, memory_order_acquire)
+                      - pos);
+    if(diff == 0){
+      if(atomic_compare_exchange_weak_explicit(&head, &pos, pos + 1,
+                                               memory_order_relaxed,
+                                               memory_order_relaxed)){
+        break;
+      }
+    } else if(diff < 0){
+      // Full: the writer is behind by a whole ring
+      if(level >= LOG_PROGRESS){
+        atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+        va_end(args);
+        return;
+      }
+      sched_yield();
+      pos = atomic_load_explicit(&head, memory_order_relaxed);
+    } else {
+      pos = atomic_load_explicit(&head, memory_order_relaxed);
+    }
+  }
+
+  len = vsnprintf(slot->text, LOG_LINE - 1, format, args);
+  va_end(args);
+  if(len < 0){
+    len = 0;
+  } else if(len > LOG_LINE - 2){
+    len = LOG_LINE - 2;
+  }
+  slot->text[len] = '\n';
+  slot->text[len + 1] = '\0';
+  atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+}
+
+/**
+ Writes out every line logged so far and stops the writer thread. Nothing
+ may be logged from other threads while this runs.
+*/
+
+void log_close(void){
+  if(slots == NULL){
+    return;
+  }
+  atomic_store(&stopping, 1);
+  pthread_join(writer, NULL);
+  free(slots);
+  slots = NULL;
+  if(atomic_load(&dropped) > 0){
+    printf("%llu progress lines were dropped to keep up\n",
+           (unsigned long long) atomic_load(&dropped));
+  }
+  fflush(output);
+}
@@ -0,0 +1,52 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+/******************************************************************************
+  Output that never holds up hashing. Lines are formatted by the thread that
+  logs them into a slot of a lock-free ring, and one writer thread copies
+  them out through a large buffer, flushing whenever the ring runs dry so
+  that results still appear promptly.
+
+  Every line has a level and is only formatted if the verbosity is at least
+  that level, so the per-candidate lines cost one comparison when they are
+  turned off. -v turns the verbosity up and -q turns it down.
+
+    LOG_RESULT    0   cracked passwords, shown even with -q
+    LOG_INFO      1   summaries, shown by default
+    LOG_PROGRESS  2   a line per chunk or salt, with -v
+    LOG_ATTEMPT   3   a line per candidate, with -vv
+
+  When the ring is full, progress and attempt lines are dropped, and the
+  number dropped is reported at the end; results wait for room instead.
+  Until log_open() and after log_close(), lines are written straight out.
+******************************************************************************/
+
+#define LOG_RESULT   0
+#define LOG_INFO     1
+#define LOG_PROGRESS 2
+#define LOG_ATTEMPT  3
+
+#define LOG_SLOTS    4096       // Lines the ring holds, a power of 2
+#define LOG_LINE     240        // Longest line, with its newline
+
+typedef struct {
+  _Alignas(64) _Atomic uint64_t seq; // Which turn of the ring the slot is on
+  char text[LOG_LINE];
+} log_slot;
+
+extern int log_verbosity;
+
+void log_open(FILE *out);
+void log_printf(int level, const char *format, ...)
+  __attribute__((format(printf, 2, 3)));
+void log_close(void);
+
+static inline int log_enabled(int level){
+  return level <= log_verbosity;
+}
+
+#endif
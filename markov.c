@@ -0,0 +1,263 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include "markov.h"
+#include "wordlist.h"
+
+/******************************************************************************
+  Training Markov models and walking keyspaces in order of probability. See
+  markov.h.
+
+  Link into a cracker with:
+    cc -O2 -o Threadcw Threadcw.c sha512crypt.c sha512mb.c targets.c pool.c \
+       mask.c checkpoint.c wordlist.c scheme.c markov.c log.c meter.c \
+       affinity.c batch.c -pthread -lcrypt -lm
+******************************************************************************/
+
+// The level of character j at position i after character p of position i-1
+#define LEVEL(mk, i, p, j) \
+  ((mk)->level[(mk)->level_at[i] + (size_t) (p) * (mk)->m->size[i] + (j)])
+
+// The endings from position i on, after character p, with r levels left
+#define COUNT(mk, i, p, r) \
+  ((mk)->count[(mk)->count_at[i] + (size_t) (p) * ((mk)->max_level + 1) + (r)])
+
+/**
+ Counts the characters of the passwords in the file at path, one per line.
+ Returns the number of passwords, or -1 if the file cannot be read.
+*/
+
+int markov_train(markov_stats *s, const char *path){
+  wordlist w;
+  const char *p, *end, *word;
+  int len, k;
+  int n = 0;
+
+  memset(s, 0, sizeof(*s));
+  if(wordlist_open(&w, path) != 0){
+    return -1;
+  }
+  end = w.map + w.size;
+  for(p=w.map; p<end; ){
+    p = wordlist_next(&w, p, &word, &len);
+    if(len <= 0){
+      continue;
+    }
+    s->start[(unsigned char) word[0]]++;
+    for(k=1; k<len; k++){
+      s->next[(unsigned char) word[k - 1]][(unsigned char) word[k]]++;
+    }
+    n++;
+  }
+  wordlist_close(&w);
+  return n;
+}
+
+/**
+ Orders the keyspace of m by the model in s. The probabilities are smoothed
+ by counting every character once more than it was seen, so characters that
+ the sample never used are tried late rather than never. Returns 0, or -1 if
+ the keyspace is too big to number.
+*/
+
+int markov_init(markov *mk, const mask *m, const markov_stats *s){
+  int len = m->length;
+  int i, p, j, r, max;
+  size_t n_levels = 0, n_counts = 0;
+
+  if(mask_keyspace(m) == UINT64_MAX){
+    fprintf(stderr, "The keyspace is too big to put in order\n");
+    return -1;
+  }
+  mk->m = m;
+  max = mk->max_level = len * (MARKOV_LEVELS - 1);
+  for(i=0; i<len; i++){
+    int prev = i > 0 ? m->size[i - 1] : 1;
+
+    mk->level_at[i] = n_levels;
+    n_levels += (size_t) prev * m->size[i];
+    mk->count_at[i] = n_counts;
+    n_counts += (size_t) prev * (max + 1);
+  }
+  mk->count_at[len] = n_counts;
+  n_counts += (size_t) (len > 0 ? m->size[len - 1] : 1) * (max + 1);
+  mk->level = malloc(n_levels > 0 ? n_levels : 1);
+  mk->count = calloc(n_counts, sizeof(uint64_t));
+  mk->below = malloc((max + 2) * sizeof(uint64_t));
+
+  for(i=0; i<len; i++){
+    for(p=0; p<(i > 0 ? m->size[i - 1] : 1); p++){
+      const uint64_t *seen = i > 0 ?
+                             s->next[(unsigned char) m->set[i - 1][p]] :
+                             s->start;
+      double total = m->size[i];
+
+      for(j=0; j<m->size[i]; j++){
+        total += seen[(unsigned char) m->set[i][j]];
+      }
+      for(j=0; j<m->size[i]; j++){
+        int level = (int) -log2((seen[(unsigned char) m->set[i][j]] + 1) /
+                                total);
+        LEVEL(mk, i, p, j) = level < MARKOV_LEVELS ? level :
+                                                     MARKOV_LEVELS - 1;
+      }
+    }
+  }
+
+  // Each count is a sum of the ones for the position after it, so none can
+  // be more than the keyspace
+  for(p=0; p<(len > 0 ? m->size[len - 1] : 1); p++){
+    COUNT(mk, len, p, 0) = 1;
+  }
+  for(i=len-1; i>=0; i--){
+    for(p=0; p<(i > 0 ? m->size[i - 1] : 1); p++){
+      for(j=0; j<m->size[i]; j++){
+        int level = LEVEL(mk, i, p, j);
+        for(r=level; r<=max; r++){
+          COUNT(mk, i, p, r) += COUNT(mk, i + 1, j, r - level);
+        }
+      }
+    }
+  }
+  mk->below[0] = 0;
+  for(r=0; r<=max; r++){
+    mk->below[r + 1] = mk->below[r] + COUNT(mk, 0, 0, r);
+  }
+  return 0;
+}
+
+void markov_free(markov *mk){
+  free(mk->level);
+  free(mk->count);
+  free(mk->below);
+}
+
+static void choose(markov_range *r, int i, int j){
+  const markov *mk = r->mk;
+
+  r->pos[i] = j;
+  r->left[i + 1] = r->left[i] - LEVEL(mk, i, i > 0 ? r->pos[i - 1] : 0, j);
+  r->plain[i] = mk->m->set[i][j];
+}
+
+/**
+ Chooses the first ending from position i on that uses up exactly the level
+ that is left, which there must be one of.
+*/
+
+static void first_ending(markov_range *r, int i){
+  const markov *mk = r->mk;
+
+  for(; i<mk->m->length; i++){
+    int p = i > 0 ? r->pos[i - 1] : 0;
+    int j;
+
+    for(j=0; ; j++){
+      int level = LEVEL(mk, i, p, j);
+      if(level <= r->left[i] &&
+         COUNT(mk, i + 1, j, r->left[i] - level) > 0){
+        break;
+      }
+    }
+    choose(r, i, j);
+  }
+}
+
+/**
+ Moves to the next candidate in order: the next ending of the same level if
+ there is one, otherwise the first candidate of the next level that has
+ any. Returns 0 after the last candidate.
+*/
+
+static int step(markov_range *r){
+  const markov *mk = r->mk;
+  int i, j;
+
+  for(i=mk->m->length-1; i>=0; i--){
+    int p = i > 0 ? r->pos[i - 1] : 0;
+
+    for(j=r->pos[i]+1; j<mk->m->size[i]; j++){
+      int level = LEVEL(mk, i, p, j);
+      if(level <= r->left[i] &&
+         COUNT(mk, i + 1, j, r->left[i] - level) > 0){
+        choose(r, i, j);
+        first_ending(r, i + 1);
+        return 1;
+      }
+    }
+  }
+  do {
+    r->total++;
+  } while(r->total <= mk->max_level && COUNT(mk, 0, 0, r->total) == 0);
+  if(r->total > mk->max_level){
+    return 0;
+  }
+  r->left[0] = r->total;
+  first_ending(r, 0);
+  return 1;
+}
+
+/**
+ Sets r up to walk the candidates numbered lo up to hi in order of
+ probability.
+*/
+
+void markov_range_init(markov_range *r, const markov *mk, uint64_t lo,
+                       uint64_t hi){
+  const mask *m = mk->m;
+  uint64_t k = lo;
+  int i, j;
+
+  r->mk = mk;
+  r->index = lo;
+  r->end = hi;
+  r->plain[m->length] = '\0';
+  if(lo >= hi || lo >= mk->below[mk->max_level + 1]){
+    r->end = lo;
+    return;
+  }
+
+  // Find the candidate's level, and then its characters one at a time by
+  // counting the endings that come before it
+  for(r->total=0; mk->below[r->total + 1]<=k; r->total++){
+  }
+  k -= mk->below[r->total];
+  r->left[0] = r->total;
+  for(i=0; i<m->length; i++){
+    int p = i > 0 ? r->pos[i - 1] : 0;
+
+    for(j=0; ; j++){
+      int level = LEVEL(mk, i, p, j);
+      uint64_t c;
+
+      if(level > r->left[i]){
+        continue;
+      }
+      c = COUNT(mk, i + 1, j, r->left[i] - level);
+      if(k < c){
+        break;
+      }
+      k -= c;
+    }
+    choose(r, i, j);
+  }
+}
+
+/**
+ Copies the next candidate in the range to out, which needs room for
+ MASK_MAX + 1 characters, and its number to index. Returns 0 once the range
+ is used up.
+*/
+
+int markov_range_next(markov_range *r, char *out, uint64_t *index){
+  if(r->index >= r->end){
+    return 0;
+  }
+  memcpy(out, r->plain, r->mk->m->length + 1);
+  *index = r->index++;
+  if(r->index < r->end){
+    step(r);
+  }
+  return 1;
+}
@@ -0,0 +1,58 @@
+#ifndef MARKOV_H
+#define MARKOV_H
+
+#include <stdint.h>
+#include "mask.h"
+
+/******************************************************************************
+  Probability ordered keyspaces. A first order Markov model is trained on a
+  sample of real passwords: how often each character starts a password and
+  how often each character follows each other one. Every character at every
+  position of a mask is then given a level, 0 for the likeliest and one more
+  each time the probability halves, and a candidate's level is the sum of
+  the levels of its characters.
+
+  The candidates of the mask are numbered in order of level, so the likely
+  ones come first, as in OMEN. Candidates with the same level are in mask
+  order. Every candidate is still in the order exactly once, so the search
+  covers the whole keyspace, and the numbering can be cut into ranges and
+  walked from any point just like a mask's, which is all that chunking,
+  slicing and checkpoints need.
+******************************************************************************/
+
+#define MARKOV_LEVELS 12        // Levels a character can be at, 0 to 11
+
+typedef struct {
+  uint64_t start[256];          // How often each character starts a word
+  uint64_t next[256][256];      // How often each character follows another
+} markov_stats;
+
+typedef struct {
+  const mask *m;
+  int max_level;                // The highest level a candidate can have
+  unsigned char *level;         // By position, previous character, character
+  uint64_t *count;              // By position, previous character and level:
+                                // the endings from that position on
+  size_t level_at[MASK_MAX];    // Where each position starts in level
+  size_t count_at[MASK_MAX + 1];// and in count
+  uint64_t *below;              // Candidates below each level
+} markov;
+
+typedef struct {
+  const markov *mk;
+  int total;                    // The level of the current candidate
+  int pos[MASK_MAX];            // Index into m->set for each position
+  int left[MASK_MAX + 1];       // Level left over for positions i onwards
+  char plain[MASK_MAX + 1];     // The current candidate
+  uint64_t index;               // Its number
+  uint64_t end;                 // The number after the last candidate
+} markov_range;
+
+int markov_train(markov_stats *s, const char *path);
+int markov_init(markov *mk, const mask *m, const markov_stats *s);
+void markov_free(markov *mk);
+void markov_range_init(markov_range *r, const markov *mk, uint64_t lo,
+                       uint64_t hi);
+int markov_range_next(markov_range *r, char *out, uint64_t *index);
+
+#endif
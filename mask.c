@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "mask.h"
+
+/******************************************************************************
+  Mask parsing and positioning for the candidate generator in mask.h.
+
+  Link into a cracker with:
+    cc -O2 -o CrackAZ99-With-Data CrackAZ99-With-Data.c sha512crypt.c \
+       sha512mb.c targets.c mask.c scheme.c table.c log.c meter.c batch.c \
+       -pthread -lcrypt -lm
+******************************************************************************/
+
+static const char *builtin(char c){
+  switch(c){
+    case 'l': return "abcdefghijklmnopqrstuvwxyz";
+    case 'u': return "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    case 'd': return "0123456789";
+    case 's': return " !\"#$%&'()*+,-./:;<=>?@[\\]^_`{|}~";
+    case 'a': return "abcdefghijklmnopqrstuvwxyz"
+                     "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                     "0123456789"
+                     " !\"#$%&'()*+,-./:;<=>?@[\\]^_`{|}~";
+    case 'h': return "0123456789abcdef";
+    case 'H': return "0123456789ABCDEF";
+  }
+  return NULL;
+}
+
+static void add_chars(char *set, int *size, const char *chars){
+  for(; *chars; chars++){
+    if(memchr(set, *chars, *size) == NULL){
+      set[(*size)++] = *chars;
+    }
+  }
+}
+
+/**
+ Expands a custom charset, which may itself use the built in ?x sets.
+ Returns -1 if it refers to an unknown set.
+*/
+
+static int expand_custom(char *set, int *size, const char *text){
+  *size = 0;
+  for(; *text; text++){
+    if(*text == '?' && text[1] != '\0' && text[1] != '?'){
+      const char *chars = builtin(*++text);
+      if(chars == NULL){
+        return -1;
+      }
+      add_chars(set, size, chars);
+    } else {
+      char c[2] = { *text, '\0' };
+      if(*text == '?' && text[1] == '?'){
+        text++;
+      }
+      add_chars(set, size, c);
+    }
+  }
+  return 0;
+}
+
+/**
+ Parses a mask. custom holds the MASK_CUSTOM charsets for ?1 to ?4, any of
+ which may be NULL, or custom itself may be NULL. Returns 0 on success, or -1
+ after explaining what is wrong with the mask.
+*/
+
+int mask_parse(mask *m, const char *text, char **custom){
+  const char *p;
+
+  m->length = 0;
+  for(p=text; *p; p++){
+    if(m->length == MASK_MAX){
+      fprintf(stderr, "Mask %s is longer than %d characters\n", text, MASK_MAX);
+      return -1;
+    }
+    m->size[m->length] = 0;
+    if(*p != '?' || p[1] == '?'){
+      m->set[m->length][0] = *p;
+      m->size[m->length] = 1;
+      if(*p == '?'){
+        p++;
+      }
+    } else if(p[1] >= '1' && p[1] < '1' + MASK_CUSTOM){
+      const char *chars = custom ? custom[p[1] - '1'] : NULL;
+      if(chars == NULL ||
+         expand_custom(m->set[m->length], &m->size[m->length], chars) != 0){
+        fprintf(stderr, "Mask %s uses ?%c but no valid charset was given\n",
+                text, p[1]);
+        return -1;
+      }
+      p++;
+    } else {
+      const char *chars = builtin(p[1]);
+      if(chars == NULL){
+        fprintf(stderr, "Mask %s uses unknown charset ?%c\n", text, p[1]);
+        return -1;
+      }
+      add_chars(m->set[m->length], &m->size[m->length], chars);
+      p++;
+    }
+    if(m->size[m->length] == 0){
+      fprintf(stderr, "Mask %s has an empty position\n", text);
+      return -1;
+    }
+    m->length++;
+  }
+  return 0;
+}
+
+/**
+ The number of candidates the mask describes, or UINT64_MAX if there are too
+ many to count in 64 bits.
+*/
+
+uint64_t mask_keyspace(const mask *m){
+  uint64_t n = 1;
+  int i;
+
+  for(i=0; i<m->length; i++){
+    if(n > UINT64_MAX / m->size[i]){
+      return UINT64_MAX;
+    }
+    n *= m->size[i];
+  }
+  return n;
+}
+
+/**
+ Points the iterator at candidate number index, counting from 0 in the order
+ that mask_next() walks them.
+*/
+
+void mask_seek(mask_iter *it, const mask *m, uint64_t index){
+  int i;
+
+  it->m = m;
+  for(i=m->length-1; i>=0; i--){
+    if(index <= UINT32_MAX){
+      break;
+    }
+    it->pos[i] = index % m->size[i];
+    index /= m->size[i];
+    it->plain[i] = m->set[i][it->pos[i]];
+  }
+  // Once the number fits in 32 bits, 32 bit division is much cheaper
+  for(; i>=0; i--){
+    uint32_t small = (uint32_t) index;
+    it->pos[i] = small % m->size[i];
+    index = small / m->size[i];
+    it->plain[i] = m->set[i][it->pos[i]];
+  }
+  it->plain[m->length] = '\0';
+}
+
+/**
+ Sets r up to walk candidates lo to hi - 1.
+*/
+
+void mask_range_init(mask_range *r, const mask *m, uint64_t lo, uint64_t hi){
+  mask_seek(&r->it, m, lo);
+  r->index = lo;
+  r->end = hi;
+}
@@ -0,0 +1,97 @@
+#ifndef MASK_H
+#define MASK_H
+
+#include <stdint.h>
+#include <string.h>
+
+/******************************************************************************
+  Masks describe a keyspace one position at a time, as in "?u?u?d?d" for two
+  uppercase letters followed by two digits. The candidates are walked like an
+  odometer: each step changes the last character and only carries into the
+  ones before it when that character wraps around.
+
+    ?l  a-z          ?u  A-Z          ?d  0-9          ?s  punctuation, space
+    ?a  ?l?u?d?s     ?h  0-9a-f       ?H  0-9A-F       ?1 - ?4  custom sets
+    ??  a literal ?  anything else stands for itself
+
+  Every candidate has a 64 bit number, its place in that order, so the
+  keyspace can be cut anywhere: mask_split() divides it into any number of
+  equal parts and a mask_range walks the candidates from lo up to hi.
+******************************************************************************/
+
+#define MASK_MAX    32          // Longest candidate a mask can describe
+#define MASK_CUSTOM 4           // Custom charsets ?1 to ?4
+
+typedef struct {
+  int length;
+  int size[MASK_MAX];           // How many characters each position has
+  char set[MASK_MAX][256];      // The characters, in the order they are tried
+} mask;
+
+typedef struct {
+  const mask *m;
+  int pos[MASK_MAX];            // Index into m->set for each position
+  char plain[MASK_MAX + 1];     // The current candidate
+} mask_iter;
+
+typedef struct {
+  mask_iter it;
+  uint64_t index;               // The number of the candidate in it.plain
+  uint64_t end;                 // The number after the last candidate
+} mask_range;
+
+int mask_parse(mask *m, const char *text, char **custom);
+uint64_t mask_keyspace(const mask *m);
+void mask_seek(mask_iter *it, const mask *m, uint64_t index);
+void mask_range_init(mask_range *r, const mask *m, uint64_t lo, uint64_t hi);
+
+/**
+ Steps to the next candidate. Returns 0, leaving the iterator back on the
+ first candidate, when the last one has been passed.
+*/
+
+static inline int mask_next(mask_iter *it){
+  int i = it->m->length - 1;
+
+  while(i >= 0){
+    if(++it->pos[i] < it->m->size[i]){
+      it->plain[i] = it->m->set[i][it->pos[i]];
+      return 1;
+    }
+    it->pos[i] = 0;
+    it->plain[i] = it->m->set[i][0];
+    i--;
+  }
+  return 0;
+}
+
+/**
+ Copies the next candidate in the range to out, which needs room for
+ MASK_MAX + 1 characters, and its number to index. Returns 0 once the range
+ is used up.
+*/
+
+static inline int mask_range_next(mask_range *r, char *out, uint64_t *index){
+  if(r->index >= r->end){
+    return 0;
+  }
+  memcpy(out, r->it.plain, r->it.m->length + 1);
+  *index = r->index++;
+  mask_next(&r->it);
+  return 1;
+}
+
+/**
+ The number of the first candidate of part out of parts equal parts of a
+ keyspace of size candidates; part parts is the end. Parts differ in size by
+ one candidate at most.
+*/
+
+static inline uint64_t mask_split(uint64_t size, uint64_t parts,
+                                  uint64_t part){
+  uint64_t extra = size % parts;
+
+  return (size / parts) * part + (part < extra ? part : extra);
+}
+
+#endif
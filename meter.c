@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "meter.h"
+#include "log.h"
+
+/******************************************************************************
+  Per-worker counters, the sampler thread and the JSON report. See meter.h.
+
+  Link into a cracker with:
+    cc -O2 -o Threadcw Threadcw.c sha512crypt.c sha512mb.c targets.c pool.c \
+       mask.c checkpoint.c wordlist.c scheme.c markov.c log.c meter.c \
+       affinity.c batch.c -pthread -lcrypt -lm
+******************************************************************************/
+
+#define POLL_NS 100000000       // How often the sampler checks for the end
+#define SMOOTHING 0.3           // Weight of the latest interval in the pace
+
+void meter_init(meter *m, int n_slots, uint64_t total){
+  int i;
+
+  m->n_slots = n_slots;
+  m->slots = aligned_alloc(_Alignof(meter_slot), n_slots * sizeof(meter_slot));
+  for(i=0; i<n_slots; i++){
+    atomic_init(&m->slots[i].hashed, 0);
+    atomic_init(&m->slots[i].done, 0);
+    atomic_init(&m->slots[i].chunks, 0);
+    atomic_init(&m->slots[i].cpu, -1);
+  }
+  m->total = total;
+  m->affinity = NULL;
+  m->sampling = 0;
+  atomic_init(&m->stopping, 0);
+  clock_gettime(CLOCK_MONOTONIC, &m->start);
+}
+
+double meter_seconds(const meter *m){
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - m->start.tv_sec) +
+         (now.tv_nsec - m->start.tv_nsec) / 1.0e9;
+}
+
+/**
+ Copies the counts of n slots from first on to out.
+*/
+
+void meter_counts(const meter *m, int first, int n, meter_count *out){
+  int i;
+
+  for(i=0; i<n; i++){
+    meter_slot *s = &m->slots[first + i];
+
+    out[i].hashed = atomic_load_explicit(&s->hashed, memory_order_relaxed);
+    out[i].done = atomic_load_explicit(&s->done, memory_order_relaxed);
+    out[i].chunks = atomic_load_explicit(&s->chunks, memory_order_relaxed);
+    out[i].cpu = atomic_load_explicit(&s->cpu, memory_order_relaxed);
+  }
+}
+
+/**
+ Adds up the counts of n slots from first on.
+*/
+
+void meter_total(const meter *m, int first, int n, meter_count *sum){
+  meter_count c;
+  int i;
+
+  sum->hashed = sum->done = sum->chunks = 0;
+  sum->cpu = -1;
+  for(i=0; i<n; i++){
+    meter_counts(m, first + i, 1, &c);
+    sum->hashed += c.hashed;
+    sum->done += c.done;
+    sum->chunks += c.chunks;
+  }
+}
+
+/**
+ Logs the rate since the last report, the share of the run that is done and
+ how long the rest will take at pace units of work a second.
+*/
+
+static void report(meter *m, const meter_count *now, const meter_count *last,
+                   double seconds, double pace){
+  double rate = (now->hashed - last->hashed) / seconds;
+  double done = m->total > 0 ? (double) now->done / m->total : 1;
+  char pinned[32] = "";
+
+  if(m->affinity){
+    snprintf(pinned, sizeof(pinned), " (%s)", m->affinity);
+  }
+  if(pace > 0 && now->done < m->total){
+    long long left = (long long) ((m->total - now->done) / pace);
+
+    log_printf(LOG_INFO, "%5.1f%% done, %.0f candidates/s%s, "
+               "%lld:%02lld:%02lld to go", 100 * done, rate, pinned,
+               left / 3600, left / 60 % 60, left % 60);
+  } else {
+    log_printf(LOG_INFO, "%5.1f%% done, %.0f candidates/s%s", 100 * done,
+               rate, pinned);
+  }
+}
+
+/**
+ The sampler thread. Chunks finish in bursts, so the pace that the time left
+ is worked out from is smoothed over the intervals rather than taken from
+ the last one alone.
+*/
+
+static void *sample(void *arg){
+  meter *m = arg;
+  struct timespec pause = {0, POLL_NS};
+  meter_count last = {0}, now;
+  double last_time = 0, time, pace = -1;
+
+  while(!atomic_load(&m->stopping)){
+    nanosleep(&pause, NULL);
+    time = meter_seconds(m);
+    if(time - last_time < m->interval){
+      continue;
+    }
+    meter_total(m, 0, m->n_slots, &now);
+    if(pace < 0){
+      pace = (now.done - last.done) / (time - last_time);
+    } else {
+      pace = SMOOTHING * (now.done - last.done) / (time - last_time) +
+             (1 - SMOOTHING) * pace;
+    }
+    report(m, &now, &last, time - last_time, pace);
+    last = now;
+    last_time = time;
+  }
+  return NULL;
+}
+
+/**
+ Starts the sampler thread, which reports every interval seconds until
+ meter_stop() is called. An interval of 0 reports nothing.
+*/
+
+void meter_start(meter *m, int interval){
+  m->interval = interval;
+  if(interval > 0){
+    m->sampling = pthread_create(&m->sampler, NULL, sample, m) == 0;
+  }
+}
+
+/**
+ Stops the sampler thread, if there is one, and then logs the average rate
+ of the whole run, whether or not there were reports along the way.
+*/
+
+void meter_stop(meter *m){
+  meter_count sum;
+  double seconds = meter_seconds(m);
+
+  if(m->sampling){
+    atomic_store(&m->stopping, 1);
+    pthread_join(m->sampler, NULL);
+    m->sampling = 0;
+  }
+  meter_total(m, 0, m->n_slots, &sum);
+  log_printf(LOG_INFO, "%llu candidates hashed at %.0f candidates/s%s%s%s",
+             (unsigned long long) sum.hashed,
+             seconds > 0 ? sum.hashed / seconds : 0,
+             m->affinity ? " (" : "", m->affinity ? m->affinity : "",
+             m->affinity ? ")" : "");
+}
+
+void meter_free(meter *m){
+  free(m->slots);
+}
+
+/**
+ Writes the counts of every thread to path as JSON, grouped by rank: counts
+ holds n_threads[0] threads' counts for rank 0, then rank 1's and so on.
+ affinity names the pinning policy, or is NULL if threads were not pinned.
+ Imbalance is the busiest thread's candidates over the average thread's, so
+ 1 means the work was spread perfectly evenly. Returns 0, or -1 if the file
+ cannot be written.
+*/
+
+int meter_json(const char *path, const char *program, const char *affinity,
+               double seconds, int n_ranks, const int *n_threads,
+               const meter_count *counts){
+  FILE *out = fopen(path, "w");
+  uint64_t all = 0;
+  int r, t, k = 0;
+
+  if(out == NULL){
+    perror(path);
+    return -1;
+  }
+  for(r=0; r<n_ranks; r++){
+    k += n_threads[r];
+  }
+  for(t=0; t<k; t++){
+    all += counts[t].hashed;
+  }
+  fprintf(out, "{\n  \"program\": \"%s\",\n  \"affinity\": \"%s\",\n"
+          "  \"seconds\": %.6f,\n  \"candidates\": %llu,\n"
+          "  \"rate\": %.1f,\n  \"ranks\": [\n", program,
+          affinity ? affinity : "none", seconds, (unsigned long long) all,
+          seconds > 0 ? all / seconds : 0);
+
+  k = 0;
+  for(r=0; r<n_ranks; r++){
+    const meter_count *c = &counts[k];
+    uint64_t sum = 0, most = 0;
+
+    for(t=0; t<n_threads[r]; t++){
+      sum += c[t].hashed;
+      most = c[t].hashed > most ? c[t].hashed : most;
+    }
+    fprintf(out, "    {\"rank\": %d, \"candidates\": %llu, \"rate\": %.1f, "
+            "\"imbalance\": %.3f,\n     \"threads\": [\n", r,
+            (unsigned long long) sum, seconds > 0 ? sum / seconds : 0,
+            sum > 0 ? (double) most * n_threads[r] / sum : 1);
+    for(t=0; t<n_threads[r]; t++){
+      fprintf(out, "       {\"thread\": %d, \"cpu\": %lld, "
+              "\"candidates\": %llu, \"chunks\": %llu, \"rate\": %.1f}%s\n",
+              t, (long long) c[t].cpu, (unsigned long long) c[t].hashed,
+              (unsigned long long) c[t].chunks,
+              seconds > 0 ? c[t].hashed / seconds : 0,
+              t < n_threads[r] - 1 ? "," : "");
+    }
+    fprintf(out, "     ]}%s\n", r < n_ranks - 1 ? "," : "");
+    k += n_threads[r];
+  }
+  fprintf(out, "  ]\n}\n");
+  if(fclose(out) != 0){
+    perror(path);
+    return -1;
+  }
+  return 0;
+}
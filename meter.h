@@ -0,0 +1,121 @@
+#ifndef METER_H
+#define METER_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+/******************************************************************************
+  Live progress. Every worker counts what it does in a slot of its own, a
+  cache line each so that counting never makes threads fight over a line,
+  and only the worker writes to its slot, so counting is a plain load and
+  store with no locked instruction.
+
+  A sampler thread adds the slots up every few seconds and logs the hash
+  rate over the last interval, how much of the run is done and how long the
+  rest will take at that rate. Work is counted in whatever units suit the
+  cracker, candidates of a mask or bytes of a wordlist for instance, as long
+  as total is in the same ones. Work that is passed over, such as chunks of
+  a salt that has been cracked, counts as done.
+
+  At the end the counts of every thread, and of every rank under MPI, can be
+  written out as JSON with meter_json(), to show how evenly the work was
+  spread, along with the CPU each thread was pinned to, if any, so that the
+  affinity policies of affinity.h can be compared.
+******************************************************************************/
+
+typedef struct {
+  _Alignas(64) _Atomic uint64_t hashed; // Candidates hashed
+  _Atomic uint64_t done;                // Units of work done or passed over
+  _Atomic uint64_t chunks;              // Chunks hashed
+  _Atomic int64_t cpu;                  // Where the worker is pinned, or -1
+} meter_slot;
+
+typedef struct {
+  uint64_t hashed;
+  uint64_t done;
+  uint64_t chunks;
+  int64_t cpu;
+} meter_count;
+
+// The size of a meter_count, for sending it to another rank as MPI_UINT64_T
+#define METER_WORDS (sizeof(meter_count) / sizeof(uint64_t))
+
+typedef struct {
+  int n_slots;
+  meter_slot *slots;
+  uint64_t total;               // Units of work in the whole run
+  const char *affinity;         // The pinning policy to report, or NULL
+  int interval;                 // Seconds between reports
+  struct timespec start;
+  pthread_t sampler;
+  int sampling;                 // Whether the sampler thread was started
+  _Atomic int stopping;
+} meter;
+
+void meter_init(meter *m, int n_slots, uint64_t total);
+void meter_start(meter *m, int interval);
+void meter_stop(meter *m);
+void meter_free(meter *m);
+void meter_counts(const meter *m, int first, int n, meter_count *out);
+void meter_total(const meter *m, int first, int n, meter_count *sum);
+double meter_seconds(const meter *m);
+int meter_json(const char *path, const char *program, const char *affinity,
+               double seconds, int n_ranks, const int *n_threads,
+               const meter_count *counts);
+
+// Only one thread writes to a slot, so it needs no read-modify-write
+static inline void meter_bump(_Atomic uint64_t *counter, uint64_t n){
+  uint64_t was = atomic_load_explicit(counter, memory_order_relaxed);
+
+  atomic_store_explicit(counter, was + n, memory_order_relaxed);
+}
+
+/**
+ Counts n candidates hashed by the slot's worker.
+*/
+
+static inline void meter_hashed(meter_slot *s, uint64_t n){
+  meter_bump(&s->hashed, n);
+}
+
+/**
+ Counts a chunk of done units of work finished by the slot's worker.
+*/
+
+static inline void meter_chunk(meter_slot *s, uint64_t done){
+  meter_bump(&s->done, done);
+  meter_bump(&s->chunks, 1);
+}
+
+/**
+ Counts done units of work outside of a chunk: work that was passed over
+ without being hashed, or progress through a long one.
+*/
+
+static inline void meter_done(meter_slot *s, uint64_t done){
+  meter_bump(&s->done, done);
+}
+
+/**
+ Replaces the slot's counts, for a slot that mirrors counts made elsewhere,
+ such as another rank's.
+*/
+
+static inline void meter_set(meter_slot *s, const meter_count *c){
+  atomic_store_explicit(&s->hashed, c->hashed, memory_order_relaxed);
+  atomic_store_explicit(&s->done, c->done, memory_order_relaxed);
+  atomic_store_explicit(&s->chunks, c->chunks, memory_order_relaxed);
+  atomic_store_explicit(&s->cpu, c->cpu, memory_order_relaxed);
+}
+
+/**
+ Records the CPU that the slot's worker was pinned to.
+*/
+
+static inline void meter_pinned(meter_slot *s, int cpu){
+  atomic_store_explicit(&s->cpu, cpu, memory_order_relaxed);
+}
+
+#endif
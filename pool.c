@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "pool.h"
+
+/******************************************************************************
+  Work-stealing thread pool. The items 0..n-1 are dealt out as one contiguous
+  range per worker. A range lives in a single 64-bit word, so both taking an
+  item from the front and stealing half from the back are one compare and
+  swap, and no locks are needed.
+
+  Link into a cracker with:
+    cc -O2 -o Threadcw Threadcw.c sha512crypt.c sha512mb.c targets.c pool.c \
+       mask.c checkpoint.c wordlist.c scheme.c markov.c log.c meter.c \
+       affinity.c batch.c -pthread -lcrypt -lm
+******************************************************************************/
+
+#define RANGE(lo, hi) (((uint64_t) (hi) << 32) | (uint32_t) (lo))
+#define RANGE_LO(r)   ((uint32_t) (r))
+#define RANGE_HI(r)   ((uint32_t) ((r) >> 32))
+
+typedef struct {
+  work_pool *pool;
+  int worker;
+} worker_arg;
+
+int pool_default_workers(void){
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+  return n > 0 ? (int) n : 1;
+}
+
+/**
+ Takes the next item from the front of the worker's own range.
+*/
+
+static int take(pool_slot *slot, uint32_t *item){
+  uint64_t r = atomic_load(&slot->range);
+
+  while(RANGE_LO(r) < RANGE_HI(r)){
+    if(atomic_compare_exchange_weak(&slot->range, &r,
+                                    RANGE(RANGE_LO(r) + 1, RANGE_HI(r)))){
+      *item = RANGE_LO(r);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ Moves the back half of another worker's range into this worker's slot,
+ which must be empty. Returns 0 once every range is empty.
+*/
+
+static int steal(work_pool *pool, int worker){
+  int i;
+
+  for(i=1; i<pool->n_workers; i++){
+    pool_slot *victim = &pool->slots[(worker + i) % pool->n_workers];
+    uint64_t r = atomic_load(&victim->range);
+
+    while(RANGE_LO(r) < RANGE_HI(r)){
+      uint32_t lo = RANGE_LO(r), hi = RANGE_HI(r);
+      uint32_t half = (hi - lo + 1) / 2;
+      if(atomic_compare_exchange_weak(&victim->range, &r,
+                                      RANGE(lo, hi - half))){
+        atomic_store(&pool->slots[worker].range, RANGE(hi - half, hi));
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+static void *worker_main(void *p){
+  worker_arg *arg = p;
+  work_pool *pool = arg->pool;
+  uint32_t item;
+
+  if(pool->start){
+    pool->start(pool->arg, arg->worker);
+  }
+  do {
+    while(!atomic_load_explicit(&pool->stop, memory_order_relaxed) &&
+          take(&pool->slots[arg->worker], &item)){
+      if(pool->fn(pool->arg, arg->worker, item)){
+        atomic_store(&pool->stop, 1);
+      }
+    }
+  } while(!atomic_load_explicit(&pool->stop, memory_order_relaxed) &&
+          steal(pool, arg->worker));
+  return NULL;
+}
+
+/**
+ Calls fn once for every item in 0..n_items-1 on n_workers threads and
+ returns 0 when they have all been done, or 1 if fn stopped the run early.
+ If no thread can be started the items are done on the calling thread.
+*/
+
+int pool_run(int n_workers, uint32_t n_items, pool_fn fn, void *arg){
+  return pool_run_start(n_workers, n_items, fn, NULL, arg);
+}
+
+/**
+ pool_run() with start called on each worker thread before it takes any
+ items.
+*/
+
+int pool_run_start(int n_workers, uint32_t n_items, pool_fn fn,
+                   pool_start_fn start, void *arg){
+  work_pool pool;
+  pthread_t *threads;
+  worker_arg *args;
+  int i, started = 0;
+
+  if(n_workers < 1){
+    n_workers = 1;
+  }
+  pool.n_workers = n_workers;
+  pool.fn = fn;
+  pool.start = start;
+  pool.arg = arg;
+  atomic_init(&pool.stop, 0);
+  pool.slots = aligned_alloc(64, n_workers * sizeof(pool_slot));
+  threads = malloc(n_workers * sizeof(pthread_t));
+  args = malloc(n_workers * sizeof(worker_arg));
+
+  for(i=0; i<n_workers; i++){
+    uint32_t lo = (uint64_t) n_items * i / n_workers;
+    uint32_t hi = (uint64_t) n_items * (i + 1) / n_workers;
+    atomic_init(&pool.slots[i].range, RANGE(lo, hi));
+  }
+
+  for(i=0; i<n_workers; i++){
+    args[i].pool = &pool;
+    args[i].worker = i;
+    if(pthread_create(&threads[i], NULL, worker_main, &args[i]) != 0){
+      // Workers that did start will steal the missing ones' items
+      fprintf(stderr, "Could only start %d of %d threads\n", i, n_workers);
+      break;
+    }
+    started++;
+  }
+  if(started == 0){
+    worker_main(&args[0]);
+  }
+  for(i=0; i<started; i++){
+    pthread_join(threads[i], NULL);
+  }
+
+  free(args);
+  free(threads);
+  free(pool.slots);
+  return atomic_load(&pool.stop);
+}
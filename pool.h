@@ -0,0 +1,38 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+/******************************************************************************
+  A work-stealing thread pool over numbered work items. Each worker owns a
+  range of item numbers and takes items from the front of it; a worker whose
+  range runs dry steals the back half of somebody else's. Once any call of
+  the work function returns non-zero no further items are started.
+
+  pool_run_start() also calls a start function on each worker thread before
+  it takes any items, for pinning the thread and setting up its state.
+******************************************************************************/
+
+typedef int (*pool_fn)(void *arg, int worker, uint32_t item);
+typedef void (*pool_start_fn)(void *arg, int worker);
+
+typedef struct {
+  _Alignas(64) _Atomic uint64_t range;  // hi << 32 | lo, items [lo, hi)
+} pool_slot;
+
+typedef struct {
+  int n_workers;
+  pool_slot *slots;
+  pool_fn fn;
+  pool_start_fn start;      // Called first on each worker, or NULL
+  void *arg;
+  _Atomic int stop;         // Set once the work function asks to stop
+} work_pool;
+
+int pool_default_workers(void);
+int pool_run(int n_workers, uint32_t n_items, pool_fn fn, void *arg);
+int pool_run_start(int n_workers, uint32_t n_items, pool_fn fn,
+                   pool_start_fn start, void *arg);
+
+#endif
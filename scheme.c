@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <math.h>
+#include "scheme.h"
+#include "sha512mb.h"
+
+/******************************************************************************
+  Recognising hash schemes and hashing candidates with the right one. See
+  scheme.h.
+
+  Link into a cracker with:
+    cc -O2 -o Threadcw Threadcw.c sha512crypt.c sha512mb.c targets.c pool.c \
+       mask.c checkpoint.c wordlist.c scheme.c markov.c log.c meter.c \
+       affinity.c batch.c -pthread -lcrypt -lm
+******************************************************************************/
+
+static const struct {
+  const char *name;
+  int text_len;             // Characters of encoded hash after the setting
+} schemes[] = {
+  {"MD5-crypt", 22},
+  {"SHA-256-crypt", 43},
+  {"SHA-512-crypt", 86},
+  {"bcrypt", 31}
+};
+
+/**
+ Returns the scheme of a hash or setting, or -1 if it is not one we know.
+*/
+
+int scheme_detect(const char *hash){
+  if(strncmp(hash, "$1$", 3) == 0){
+    return SCHEME_MD5;
+  } else if(strncmp(hash, "$5$", 3) == 0){
+    return SCHEME_SHA256;
+  } else if(strncmp(hash, "$6$", 3) == 0){
+    return SCHEME_SHA512;
+  } else if(strncmp(hash, "$2", 2) == 0 && hash[2] != '\0' &&
+            strchr("aby", hash[2]) != NULL && hash[3] == '$'){
+    return SCHEME_BCRYPT;
+  }
+  return -1;
+}
+
+const char *scheme_name(int scheme){
+  return schemes[scheme].name;
+}
+
+/**
+ The length of the setting at the start of a hash: the prefix, any rounds=,
+ the salt and, except for bcrypt, the $ after it. -1 if it is malformed.
+*/
+
+static int setting_len(const char *hash, int scheme){
+  const char *p = hash + 3;
+  size_t n = 0;
+
+  if(scheme == SCHEME_SHA512){
+    return sha512crypt_setting_len(hash);
+  } else if(scheme == SCHEME_BCRYPT){
+    // $2b$NN$ and 22 characters of salt
+    if(!isdigit((unsigned char) hash[4]) || !isdigit((unsigned char) hash[5]) ||
+       hash[6] != '$' || strlen(hash) < 29){
+      return -1;
+    }
+    return 29;
+  }
+  if(scheme == SCHEME_SHA256 && strncmp(p, "rounds=", 7) == 0){
+    p = strchr(p, '$');
+    if(p == NULL){
+      return -1;
+    }
+    p++;
+  }
+  while(p[n] != '\0' && p[n] != '$'){
+    n++;
+  }
+  if(p[n] != '$' || n > (scheme == SCHEME_MD5 ? 8 : 16)){
+    return -1;
+  }
+  return (int) (p + n + 1 - hash);
+}
+
+static int b64_value(char c){
+  if(c >= 'a' && c <= 'z'){
+    return c - 'a' + 38;
+  } else if(c >= 'A' && c <= 'Z'){
+    return c - 'A' + 12;
+  } else if(c >= '.' && c <= '9'){
+    return c - '.';
+  }
+  return -1;
+}
+
+/**
+ Packs len characters of encoded hash into 64 bytes, 6 bits to a character.
+ Returns 0, or -1 if there is a character that no scheme uses.
+*/
+
+static int pack_text(const char *text, size_t len, unsigned char *digest){
+  uint32_t bits = 0;
+  int n = 0;
+  size_t i;
+
+  memset(digest, 0, SHA512CRYPT_DIGEST_LEN);
+  for(i=0; i<len; i++){
+    int v = b64_value(text[i]);
+    if(v < 0){
+      return -1;
+    }
+    bits = (bits << 6) | v;
+    n += 6;
+    if(n >= 8){
+      n -= 8;
+      *digest++ = bits >> n;
+    }
+  }
+  if(n > 0){
+    *digest = bits << (8 - n);
+  }
+  return 0;
+}
+
+/**
+ Splits a hash into its setting and the 64 bytes that identify it. Returns
+ the length of the setting, or -1 if the hash is not one we can crack.
+*/
+
+int scheme_split(const char *hash, int *scheme, unsigned char *digest){
+  int s = scheme_detect(hash);
+  int len;
+
+  if(s < 0){
+    return -1;
+  }
+  len = setting_len(hash, s);
+  if(len < 0 || len >= SHA512CRYPT_SETTING_MAX){
+    return -1;
+  }
+  if(s == SCHEME_SHA512){
+    if(sha512crypt_decode(hash + len, strlen(hash + len), digest) != 0){
+      return -1;
+    }
+  } else if(strlen(hash + len) != (size_t) schemes[s].text_len ||
+            pack_text(hash + len, schemes[s].text_len, digest) != 0){
+    return -1;
+  }
+  *scheme = s;
+  return len;
+}
+
+/**
+ Roughly how long one candidate takes to hash with a setting, in units of
+ SHA-512-crypt with the default 5000 rounds. The figures were measured with
+ libcrypt on one core; only the ratios between them matter.
+*/
+
+double scheme_cost(const char *setting){
+  int scheme = scheme_detect(setting);
+  unsigned long rounds = SHA512CRYPT_ROUNDS_DEFAULT;
+
+  if(scheme == SCHEME_MD5){
+    return 0.07;
+  } else if(scheme == SCHEME_BCRYPT){
+    return 0.85 * ldexp(1.0, atoi(setting + 4) - 5);
+  }
+  if(strncmp(setting + 3, "rounds=", 7) == 0){
+    rounds = strtoul(setting + 10, NULL, 10);
+    if(rounds < SHA512CRYPT_ROUNDS_MIN){
+      rounds = SHA512CRYPT_ROUNDS_MIN;
+    }
+  }
+  return (scheme == SCHEME_SHA256 ? 1.4 : 1.0) * rounds /
+         SHA512CRYPT_ROUNDS_DEFAULT;
+}
+
+/**
+ How many candidates to put in a chunk for a setting so that it takes about
+ as long as base candidates of default SHA-512-crypt. Chunks of cheap salts
+ hold more candidates, so that when the chunks of every salt are handed out
+ in turn, cheap salts are not kept waiting behind expensive ones. The result
+ is a multiple of lanes.
+*/
+
+uint32_t scheme_chunk(const char *setting, uint32_t base, int lanes){
+  double n = base / scheme_cost(setting);
+  uint32_t chunk;
+
+  if(n > 1e6){
+    n = 1e6;
+  }
+  chunk = ((uint32_t) n / lanes) * lanes;
+  return chunk > 0 ? chunk : (uint32_t) lanes;
+}
+
+void scheme_ctx_init(scheme_ctx *c){
+  c->setting = NULL;
+  c->data = NULL;
+}
+
+/**
+ Sets c up to hash with setting, which must stay where it is while c uses
+ it. Costs nothing when c is already set up for it.
+*/
+
+void scheme_ctx_set(scheme_ctx *c, const char *setting){
+  if(c->setting == setting){
+    return;
+  }
+  c->scheme = scheme_detect(setting);
+  if(c->scheme == SCHEME_SHA512){
+    sha512crypt_parse_salt(&c->salt, setting);
+  }
+  c->setting = setting;
+}
+
+/**
+ Hashes n keys of key_len characters. SHA-512-crypt hashes them together in
+ SIMD lanes, so n must be no more than sha512mb_lanes(engine); the other
+ schemes hash them one at a time, and need the keys to be terminated.
+*/
+
+void scheme_hash(scheme_ctx *c, int engine, const char *const *keys,
+                 size_t key_len, int n,
+                 unsigned char (*digests)[SHA512CRYPT_DIGEST_LEN]){
+  int text_len = schemes[c->scheme].text_len;
+  int i;
+
+  if(c->scheme == SCHEME_SHA512){
+    sha512crypt_mb(engine, &c->salt, keys, key_len, n, digests);
+    return;
+  }
+  if(c->data == NULL){
+    c->data = calloc(1, sizeof(struct crypt_data));
+  }
+  for(i=0; i<n; i++){
+    const char *out = crypt_rn(keys[i], c->setting, c->data,
+                               sizeof(struct crypt_data));
+    size_t len = out ? strlen(out) : 0;
+
+    if(len < (size_t) text_len ||
+       pack_text(out + len - text_len, text_len, digests[i]) != 0){
+      // Matches nothing: a packed hash always ends in zeros
+      memset(digests[i], 0xff, SHA512CRYPT_DIGEST_LEN);
+    }
+  }
+}
+
+void scheme_ctx_free(scheme_ctx *c){
+  free(c->data);
+  c->data = NULL;
+}
@@ -0,0 +1,52 @@
+#ifndef SCHEME_H
+#define SCHEME_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <crypt.h>
+#include "sha512crypt.h"
+
+/******************************************************************************
+  The hash schemes the crackers understand, told apart by the prefix of each
+  hash:
+
+    $1$     MD5-crypt
+    $5$     SHA-256-crypt, with or without rounds=
+    $6$     SHA-512-crypt, with or without rounds=
+    $2a$ $2b$ $2y$   bcrypt
+
+  SHA-512-crypt goes through the native SIMD engines in sha512mb.c. The others
+  are hashed with crypt_rn() from libcrypt, into a crypt_data that belongs to
+  the calling thread, so no state is shared between threads.
+
+  Every target is reduced to 64 bytes that the lookup tables in targets.c can
+  compare. For SHA-512-crypt that is the raw digest; for the others it is the
+  encoded hash text packed 6 bits to a character, which is just as unique.
+******************************************************************************/
+
+#define SCHEME_MD5      0
+#define SCHEME_SHA256   1
+#define SCHEME_SHA512   2
+#define SCHEME_BCRYPT   3
+
+typedef struct {
+  const char *setting;      // The setting the context is set up for, or NULL
+  int scheme;
+  sha512crypt_salt salt;    // For SHA-512-crypt
+  struct crypt_data *data;  // For the others, allocated on first use
+} scheme_ctx;
+
+int scheme_detect(const char *hash);
+const char *scheme_name(int scheme);
+int scheme_split(const char *hash, int *scheme, unsigned char *digest);
+double scheme_cost(const char *setting);
+uint32_t scheme_chunk(const char *setting, uint32_t base, int lanes);
+
+void scheme_ctx_init(scheme_ctx *c);
+void scheme_ctx_set(scheme_ctx *c, const char *setting);
+void scheme_hash(scheme_ctx *c, int engine, const char *const *keys,
+                 size_t key_len, int n,
+                 unsigned char (*digests)[SHA512CRYPT_DIGEST_LEN]);
+void scheme_ctx_free(scheme_ctx *c);
+
+#endif
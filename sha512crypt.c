@@ -0,0 +1,512 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "sha512crypt.h"
+
+/******************************************************************************
+  Native implementation of SHA-512-crypt as described in Ulrich Drepper's
+  "Unix crypt using SHA-256 and SHA-512" specification. It produces the same
+  strings as crypt(key, "$6$...") from libcrypt, but the crackers use
+  sha512crypt_raw() directly and never pay for the base64 step in the hot loop.
+
+  Link into a cracker with:
+    cc -O2 -o CrackAZ99-With-Data CrackAZ99-With-Data.c sha512crypt.c
+******************************************************************************/
+
+const uint64_t sha512_k[80] = {
+  0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL,
+  0xe9b5dba58189dbbcULL, 0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL,
+  0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL, 0xd807aa98a3030242ULL,
+  0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+  0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL,
+  0xc19bf174cf692694ULL, 0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL,
+  0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL, 0x2de92c6f592b0275ULL,
+  0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+  0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL,
+  0xbf597fc7beef0ee4ULL, 0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL,
+  0x06ca6351e003826fULL, 0x142929670a0e6e70ULL, 0x27b70a8546d22ffcULL,
+  0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+  0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL,
+  0x92722c851482353bULL, 0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL,
+  0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL, 0xd192e819d6ef5218ULL,
+  0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+  0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL,
+  0x34b0bcb5e19b48a8ULL, 0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL,
+  0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL, 0x748f82ee5defb2fcULL,
+  0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+  0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL,
+  0xc67178f2e372532bULL, 0xca273eceea26619cULL, 0xd186b8c721c0c207ULL,
+  0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL, 0x06f067aa72176fbaULL,
+  0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+  0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL,
+  0x431d67c49c100d4cULL, 0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL,
+  0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL
+};
+
+const uint64_t sha512_h0[8] = {
+  0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL,
+  0xa54ff53a5f1d36f1ULL, 0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL,
+  0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+};
+
+static const char b64t[] =
+  "./0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+
+#define ROTR64(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
+
+static uint64_t load_be64(const unsigned char *p){
+  return ((uint64_t) p[0] << 56) | ((uint64_t) p[1] << 48) |
+         ((uint64_t) p[2] << 40) | ((uint64_t) p[3] << 32) |
+         ((uint64_t) p[4] << 24) | ((uint64_t) p[5] << 16) |
+         ((uint64_t) p[6] << 8)  |  (uint64_t) p[7];
+}
+
+static void store_be64(unsigned char *p, uint64_t v){
+  int i;
+
+  for(i=7; i>=0; i--){
+    p[i] = (unsigned char) v;
+    v >>= 8;
+  }
+}
+
+/**
+ Compresses a block that is already in big-endian words.
+*/
+
+static void compress_words(uint64_t *h, const uint64_t *block){
+  uint64_t w[80];
+  uint64_t a, b, c, d, e, f, g, k;
+  uint64_t t1, t2;
+  int t;
+
+  for(t=0; t<16; t++){
+    w[t] = block[t];
+  }
+  for(t=16; t<80; t++){
+    uint64_t s0 = ROTR64(w[t-15], 1) ^ ROTR64(w[t-15], 8) ^ (w[t-15] >> 7);
+    uint64_t s1 = ROTR64(w[t-2], 19) ^ ROTR64(w[t-2], 61) ^ (w[t-2] >> 6);
+    w[t] = w[t-16] + s0 + w[t-7] + s1;
+  }
+
+  a = h[0]; b = h[1]; c = h[2]; d = h[3];
+  e = h[4]; f = h[5]; g = h[6]; k = h[7];
+
+  for(t=0; t<80; t++){
+    t1 = k + (ROTR64(e, 14) ^ ROTR64(e, 18) ^ ROTR64(e, 41)) +
+         ((e & f) ^ (~e & g)) + sha512_k[t] + w[t];
+    t2 = (ROTR64(a, 28) ^ ROTR64(a, 34) ^ ROTR64(a, 39)) +
+         ((a & b) ^ (a & c) ^ (b & c));
+    k = g; g = f; f = e; e = d + t1;
+    d = c; c = b; b = a; a = t1 + t2;
+  }
+
+  h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+  h[4] += e; h[5] += f; h[6] += g; h[7] += k;
+}
+
+void sha512_compress(uint64_t *h, const unsigned char *block){
+  uint64_t w[16];
+  int t;
+
+  for(t=0; t<16; t++){
+    w[t] = load_be64(block + 8 * t);
+  }
+  compress_words(h, w);
+}
+
+void sha512_init(sha512_ctx *ctx){
+  memcpy(ctx->h, sha512_h0, sizeof(sha512_h0));
+  ctx->length = 0;
+  ctx->fill = 0;
+}
+
+void sha512_update(sha512_ctx *ctx, const void *data, size_t len){
+  const unsigned char *p = data;
+
+  ctx->length += len;
+  if(ctx->fill > 0){
+    size_t n = 128 - ctx->fill;
+    if(n > len){
+      n = len;
+    }
+    memcpy(ctx->buf + ctx->fill, p, n);
+    ctx->fill += n;
+    p += n;
+    len -= n;
+    if(ctx->fill < 128){
+      return;
+    }
+    sha512_compress(ctx->h, ctx->buf);
+    ctx->fill = 0;
+  }
+  while(len >= 128){
+    sha512_compress(ctx->h, p);
+    p += 128;
+    len -= 128;
+  }
+  memcpy(ctx->buf, p, len);
+  ctx->fill = len;
+}
+
+void sha512_final(sha512_ctx *ctx, unsigned char *digest){
+  int i;
+
+  ctx->buf[ctx->fill++] = 0x80;
+  if(ctx->fill > 112){
+    memset(ctx->buf + ctx->fill, 0, 128 - ctx->fill);
+    sha512_compress(ctx->h, ctx->buf);
+    ctx->fill = 0;
+  }
+  memset(ctx->buf + ctx->fill, 0, 112 - ctx->fill);
+  store_be64(ctx->buf + 112, ctx->length >> 61);
+  store_be64(ctx->buf + 120, ctx->length << 3);
+  sha512_compress(ctx->h, ctx->buf);
+
+  for(i=0; i<8; i++){
+    store_be64(digest + 8 * i, ctx->h[i]);
+  }
+}
+
+/**
+ Parses "$6$[rounds=N$]salt[$...]". Anything after the salt, such as the
+ encrypted part of a full hash, is ignored so a target can be passed as is.
+ Returns 0 on success and -1 if the setting is not SHA-512-crypt.
+*/
+
+int sha512crypt_parse_salt(sha512crypt_salt *salt, const char *setting){
+  const char *p = setting;
+  sha512_ctx ctx;
+  unsigned char ds[SHA512CRYPT_DIGEST_LEN];
+  int a0, i;
+
+  if(strncmp(p, "$6$", 3) != 0){
+    return -1;
+  }
+  p += 3;
+
+  salt->rounds = SHA512CRYPT_ROUNDS_DEFAULT;
+  salt->rounds_custom = 0;
+  if(strncmp(p, "rounds=", 7) == 0){
+    char *end;
+    unsigned long r = strtoul(p + 7, &end, 10);
+    if(end == p + 7 || *end != '$'){
+      return -1;
+    }
+    if(r < SHA512CRYPT_ROUNDS_MIN){
+      r = SHA512CRYPT_ROUNDS_MIN;
+    } else if(r > SHA512CRYPT_ROUNDS_MAX){
+      r = SHA512CRYPT_ROUNDS_MAX;
+    }
+    salt->rounds = r;
+    salt->rounds_custom = 1;
+    p = end + 1;
+  }
+
+  salt->salt_len = 0;
+  while(p[salt->salt_len] != '\0' && p[salt->salt_len] != '$' &&
+        salt->salt_len < SHA512CRYPT_SALT_MAX){
+    salt->salt_len++;
+  }
+  memcpy(salt->salt, p, salt->salt_len);
+  salt->salt[salt->salt_len] = '\0';
+
+  if(salt->rounds_custom){
+    salt->setting_len = sprintf(salt->setting, "$6$rounds=%lu$%s$",
+                                salt->rounds, salt->salt);
+  } else {
+    salt->setting_len = sprintf(salt->setting, "$6$%s$", salt->salt);
+  }
+
+  for(a0=0; a0<256; a0++){
+    sha512_init(&ctx);
+    for(i=0; i<16+a0; i++){
+      sha512_update(&ctx, salt->salt, salt->salt_len);
+    }
+    sha512_final(&ctx, ds);
+    memcpy(salt->s_bytes[a0], ds, salt->salt_len);
+  }
+  return 0;
+}
+
+/**
+ Does the per-candidate work that comes before the round loop: digest A goes
+ into digest and the P-bytes into p_bytes, which needs key_len bytes. Returns
+ the S-bytes to use, or NULL if the key is longer than SHA512CRYPT_KEY_MAX.
+*/
+
+const unsigned char *sha512crypt_prepare(const sha512crypt_salt *salt,
+                                         const char *key, size_t key_len,
+                                         unsigned char *digest,
+                                         unsigned char *p_bytes){
+  sha512_ctx ctx;
+  unsigned char alt[SHA512CRYPT_DIGEST_LEN];
+  size_t cnt;
+
+  if(key_len > SHA512CRYPT_KEY_MAX){
+    return NULL;
+  }
+
+  // Digest B: key, salt, key
+  sha512_init(&ctx);
+  sha512_update(&ctx, key, key_len);
+  sha512_update(&ctx, salt->salt, salt->salt_len);
+  sha512_update(&ctx, key, key_len);
+  sha512_final(&ctx, alt);
+
+  // Digest A
+  sha512_init(&ctx);
+  sha512_update(&ctx, key, key_len);
+  sha512_update(&ctx, salt->salt, salt->salt_len);
+  for(cnt=key_len; cnt>64; cnt-=64){
+    sha512_update(&ctx, alt, 64);
+  }
+  sha512_update(&ctx, alt, cnt);
+  for(cnt=key_len; cnt>0; cnt>>=1){
+    if(cnt & 1){
+      sha512_update(&ctx, alt, 64);
+    } else {
+      sha512_update(&ctx, key, key_len);
+    }
+  }
+  sha512_final(&ctx, digest);
+
+  // P-bytes come from the key hashed key_len times
+  sha512_init(&ctx);
+  for(cnt=0; cnt<key_len; cnt++){
+    sha512_update(&ctx, key, key_len);
+  }
+  sha512_final(&ctx, alt);
+  for(cnt=0; cnt+64<=key_len; cnt+=64){
+    memcpy(p_bytes + cnt, alt, 64);
+  }
+  memcpy(p_bytes + cnt, alt, key_len - cnt);
+
+  return salt->s_bytes[digest[0]];
+}
+
+/**
+ Lays out the padded message of every kind of round for one candidate, as
+ described for sha512crypt_pattern. The gap for the digest is left as zero.
+*/
+
+void sha512crypt_patterns(sha512crypt_pattern *patterns,
+                          const unsigned char *p_bytes, size_t key_len,
+                          const unsigned char *s_bytes, size_t salt_len){
+  unsigned char msg[SHA512CRYPT_BLOCKS_MAX * 128];
+  int kind, t;
+
+  for(kind=0; kind<SHA512CRYPT_PATTERNS; kind++){
+    sha512crypt_pattern *pattern = &patterns[kind];
+    unsigned char *m = msg;
+    size_t len;
+
+    memset(msg, 0, sizeof(msg));
+    if(kind & 1){
+      memcpy(m, p_bytes, key_len); m += key_len;
+    } else {
+      m += 64;
+    }
+    if(kind & 2){
+      memcpy(m, s_bytes, salt_len); m += salt_len;
+    }
+    if(kind & 4){
+      memcpy(m, p_bytes, key_len); m += key_len;
+    }
+    if(kind & 1){
+      pattern->offset = m - msg;
+      m += 64;
+    } else {
+      pattern->offset = 0;
+      memcpy(m, p_bytes, key_len); m += key_len;
+    }
+    len = m - msg;
+    *m = 0x80;
+    pattern->blocks = (len + 17 + 127) / 128;
+    store_be64(msg + pattern->blocks * 128 - 8, (uint64_t) len << 3);
+    for(t=0; t<pattern->blocks * 16; t++){
+      pattern->words[t] = load_be64(msg + 8 * t);
+    }
+  }
+}
+
+/**
+ Copies a digest, given as its 8 big-endian words, into the gap that a
+ pattern leaves for it at byte offset. The bytes on either side of the gap
+ are kept as they are.
+*/
+
+static void place_digest(uint64_t *words, int offset, const uint64_t *h){
+  uint64_t *w = words + offset / 8;
+  int shift = 8 * (offset % 8);
+  int i;
+
+  if(shift == 0){
+    memcpy(w, h, 8 * sizeof(uint64_t));
+    return;
+  }
+  w[0] = (w[0] & ~(~0ULL >> shift)) | h[0] >> shift;
+  for(i=1; i<8; i++){
+    w[i] = h[i-1] << (64 - shift) | h[i] >> shift;
+  }
+  w[8] = h[7] << (64 - shift) | (w[8] & ~0ULL >> shift);
+}
+
+/**
+ Hashes one candidate into a raw 64 byte digest. Returns -1 if the key is
+ longer than SHA512CRYPT_KEY_MAX, 0 otherwise.
+
+ The rounds never go through sha512_update() and sha512_final(): the digest
+ stays in words from one round to the next and is dropped into the message
+ of the round's kind, which is then compressed as it is.
+*/
+
+int sha512crypt_raw(const sha512crypt_salt *salt, const char *key,
+                    size_t key_len, unsigned char *digest){
+  sha512crypt_pattern patterns[SHA512CRYPT_PATTERNS];
+  unsigned char p_bytes[SHA512CRYPT_KEY_MAX];
+  const unsigned char *s_bytes;
+  uint64_t h[8];
+  unsigned long r;
+  int i, b;
+
+  s_bytes = sha512crypt_prepare(salt, key, key_len, digest, p_bytes);
+  if(s_bytes == NULL){
+    return -1;
+  }
+  sha512crypt_patterns(patterns, p_bytes, key_len, s_bytes, salt->salt_len);
+
+  for(i=0; i<8; i++){
+    h[i] = load_be64(digest + 8 * i);
+  }
+  for(r=0; r<salt->rounds; r++){
+    sha512crypt_pattern *pattern = &patterns[sha512crypt_pattern_of(r)];
+
+    place_digest(pattern->words, pattern->offset, h);
+    memcpy(h, sha512_h0, sizeof(h));
+    for(b=0; b<pattern->blocks; b++){
+      compress_words(h, pattern->words + 16 * b);
+    }
+  }
+  for(i=0; i<8; i++){
+    store_be64(digest + 8 * i, h[i]);
+  }
+  return 0;
+}
+
+/**
+ Writes the full crypt() style string for a digest into out, which must hold
+ SHA512CRYPT_HASH_MAX characters. Returns out.
+*/
+
+char *sha512crypt_format(const sha512crypt_salt *salt,
+                         const unsigned char *digest, char *out){
+  char *p = out;
+  int i;
+
+  memcpy(p, salt->setting, salt->setting_len);
+  p += salt->setting_len;
+
+  for(i=0; i<21; i++){
+    // Drepper's byte order: each group takes one byte from each third
+    int b0 = (i % 3 == 0) ? i : (i % 3 == 1) ? i + 21 : i + 42;
+    int b1 = (i % 3 == 0) ? i + 21 : (i % 3 == 1) ? i + 42 : i;
+    int b2 = (i % 3 == 0) ? i + 42 : (i % 3 == 1) ? i : i + 21;
+    unsigned int w = (digest[b0] << 16) | (digest[b1] << 8) | digest[b2];
+    int n;
+    for(n=0; n<4; n++){
+      *p++ = b64t[w & 0x3f];
+      w >>= 6;
+    }
+  }
+  *p++ = b64t[digest[63] & 0x3f];
+  *p++ = b64t[digest[63] >> 6];
+  *p = '\0';
+  return out;
+}
+
+/**
+ Returns the length of the "$6$[rounds=N$]salt$" part at the start of a full
+ hash, or -1 if hash is not SHA-512-crypt or has no encrypted part.
+*/
+
+int sha512crypt_setting_len(const char *hash){
+  const char *p = hash;
+  size_t n = 0;
+
+  if(strncmp(p, "$6$", 3) != 0){
+    return -1;
+  }
+  p += 3;
+  if(strncmp(p, "rounds=", 7) == 0){
+    p = strchr(p, '$');
+    if(p == NULL){
+      return -1;
+    }
+    p++;
+  }
+  while(p[n] != '\0' && p[n] != '$'){
+    n++;
+  }
+  if(p[n] != '$' || n > SHA512CRYPT_SALT_MAX){
+    return -1;
+  }
+  return (int) (p + n + 1 - hash);
+}
+
+/**
+ The position of each ASCII character in b64t, or -1. Hash files can have
+ millions of lines to decode, so this is a lookup rather than a search.
+*/
+
+static const signed char b64v[128] = {
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  0,  1,
+   2,  3,  4,  5,  6,  7,  8,  9, 10, 11, -1, -1, -1, -1, -1, -1,
+  -1, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26,
+  27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, -1, -1, -1, -1, -1,
+  -1, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 52,
+  53, 54, 55, 56, 57, 58, 59, 60, 61, 62, 63, -1, -1, -1, -1, -1
+};
+
+/**
+ The inverse of the base64 step in sha512crypt_format(). text is the encrypted
+ part of a hash, which has to be 86 characters long. Returns 0, or -1 if text
+ is malformed.
+*/
+
+int sha512crypt_decode(const char *text, size_t len, unsigned char *digest){
+  unsigned int w;
+  int i, n;
+
+  if(len != 86){
+    return -1;
+  }
+  for(i=0; i<22; i++){
+    int chars = (i < 21) ? 4 : 2;
+    w = 0;
+    for(n=chars-1; n>=0; n--){
+      unsigned char ch = text[4 * i + n];
+      int c = ch < 128 ? b64v[ch] : -1;
+      if(c < 0){
+        return -1;
+      }
+      w = (w << 6) | (unsigned int) c;
+    }
+    if(i == 21){
+      if(w > 0xff){
+        return -1;
+      }
+      digest[63] = w;
+    } else {
+      int b0 = (i % 3 == 0) ? i : (i % 3 == 1) ? i + 21 : i + 42;
+      int b1 = (i % 3 == 0) ? i + 21 : (i % 3 == 1) ? i + 42 : i;
+      int b2 = (i % 3 == 0) ? i + 42 : (i % 3 == 1) ? i : i + 21;
+      digest[b0] = w >> 16;
+      digest[b1] = w >> 8;
+      digest[b2] = w;
+    }
+  }
+  return 0;
+}
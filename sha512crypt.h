@@ -0,0 +1,113 @@
+#ifndef SHA512CRYPT_H
+#define SHA512CRYPT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/******************************************************************************
+  Native SHA-512-crypt ($6$) engine shared by the password crackers.
+
+  Unlike crypt() from libcrypt this keeps no global state: the salt is parsed
+  once per target into a sha512crypt_salt, and every candidate is hashed into
+  a caller supplied 64 byte digest, so any number of threads can hash at once.
+******************************************************************************/
+
+#define SHA512CRYPT_DIGEST_LEN     64
+#define SHA512CRYPT_SALT_MAX       16
+#define SHA512CRYPT_KEY_MAX        256
+#define SHA512CRYPT_ROUNDS_DEFAULT 5000
+#define SHA512CRYPT_ROUNDS_MIN     1000
+#define SHA512CRYPT_ROUNDS_MAX     999999999UL
+#define SHA512CRYPT_SETTING_MAX    (3 + 17 + SHA512CRYPT_SALT_MAX + 1)
+#define SHA512CRYPT_HASH_MAX       (SHA512CRYPT_SETTING_MAX + 86 + 1)
+#define SHA512CRYPT_PATTERNS       8
+
+// Longest round message: P-bytes, S-bytes, P-bytes and a digest, plus padding
+#define SHA512CRYPT_BLOCKS_MAX \
+  ((2 * SHA512CRYPT_KEY_MAX + SHA512CRYPT_SALT_MAX + 64 + 17 + 127) / 128)
+
+typedef struct {
+  uint64_t h[8];
+  uint64_t length;          // Bytes hashed so far
+  unsigned char buf[128];
+  size_t fill;              // Bytes waiting in buf
+} sha512_ctx;
+
+/**
+ Everything about a $6$ setting that does not depend on the candidate. The
+ S-bytes of the algorithm only depend on the salt and the first byte of the
+ intermediate digest, so all 256 possibilities are worked out up front.
+*/
+typedef struct {
+  char salt[SHA512CRYPT_SALT_MAX + 1];
+  size_t salt_len;
+  unsigned long rounds;
+  int rounds_custom;        // Non-zero when the setting had rounds=
+  char setting[SHA512CRYPT_SETTING_MAX];
+  size_t setting_len;       // "$6$[rounds=N$]salt$"
+  unsigned char s_bytes[256][SHA512CRYPT_SALT_MAX];
+} sha512crypt_salt;
+
+/**
+ The message of one kind of round. A round hashes the previous digest and
+ the P-bytes in an order set by whether it is odd, with the S-bytes unless
+ it is a multiple of 3 and the P-bytes again unless it is a multiple of 7,
+ which makes 8 kinds that repeat every 42 rounds. Only the digest changes
+ from one round of a kind to the next, so each kind's message is laid out
+ and padded once per candidate as big-endian words, with a gap at offset
+ that the previous digest is copied into before each round.
+*/
+typedef struct {
+  int blocks;               // 128 byte blocks to compress
+  int offset;               // Byte offset of the previous digest
+  uint64_t words[SHA512CRYPT_BLOCKS_MAX * 16];
+} sha512crypt_pattern;
+
+extern const uint64_t sha512_k[80];
+extern const uint64_t sha512_h0[8];
+
+void sha512_init(sha512_ctx *ctx);
+void sha512_update(sha512_ctx *ctx, const void *data, size_t len);
+void sha512_final(sha512_ctx *ctx, unsigned char *digest);
+void sha512_compress(uint64_t *h, const unsigned char *block);
+
+int sha512crypt_parse_salt(sha512crypt_salt *salt, const char *setting);
+const unsigned char *sha512crypt_prepare(const sha512crypt_salt *salt,
+                                         const char *key, size_t key_len,
+                                         unsigned char *digest,
+                                         unsigned char *p_bytes);
+void sha512crypt_patterns(sha512crypt_pattern *patterns,
+                          const unsigned char *p_bytes, size_t key_len,
+                          const unsigned char *s_bytes, size_t salt_len);
+int sha512crypt_raw(const sha512crypt_salt *salt, const char *key,
+                    size_t key_len, unsigned char *digest);
+char *sha512crypt_format(const sha512crypt_salt *salt,
+                         const unsigned char *digest, char *out);
+int sha512crypt_setting_len(const char *hash);
+int sha512crypt_decode(const char *text, size_t len, unsigned char *digest);
+
+/**
+ Returns which of the SHA512CRYPT_PATTERNS kinds round r is.
+*/
+
+static inline int sha512crypt_pattern_of(unsigned long r){
+  return (int) (r & 1) | (r % 3 != 0) << 1 | (r % 7 != 0) << 2;
+}
+
+/**
+ Compares two digests. The first 8 bytes are compared as one word before the
+ rest is looked at, and as a wrong candidate almost always differs there,
+ that is usually all it costs.
+*/
+
+static inline int sha512crypt_equal(const unsigned char *a,
+                                    const unsigned char *b){
+  uint64_t x, y;
+
+  memcpy(&x, a, sizeof(x));
+  memcpy(&y, b, sizeof(y));
+  return x == y && memcmp(a + 8, b + 8, SHA512CRYPT_DIGEST_LEN - 8) == 0;
+}
+
+#endif
@@ -0,0 +1,318 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <immintrin.h>
+#include "sha512mb.h"
+
+/******************************************************************************
+  Multi-buffer SHA-512-crypt kernels. The set-up before the round loop is done
+  per candidate with the scalar engine, then the 5000 (or rounds=) iterations
+  run in lockstep: because every lane has the same key length and salt, every
+  round has the same message layout in every lane and only the bytes differ.
+  The messages of the 8 kinds of round are laid out across the lanes once,
+  so a round only has to drop the previous digest into its kind's message.
+
+  The AVX2 and AVX-512 kernels are compiled with target attributes, so no
+  special compiler flags are needed and the choice is made at run time:
+
+    cc -O2 -o CrackAZ99-With-Data CrackAZ99-With-Data.c sha512crypt.c \
+       sha512mb.c
+******************************************************************************/
+
+typedef uint64_t lane_words[SHA512MB_LANES_MAX];
+
+static uint64_t load_be64(const unsigned char *p){
+  return ((uint64_t) p[0] << 56) | ((uint64_t) p[1] << 48) |
+         ((uint64_t) p[2] << 40) | ((uint64_t) p[3] << 32) |
+         ((uint64_t) p[4] << 24) | ((uint64_t) p[5] << 16) |
+         ((uint64_t) p[6] << 8)  |  (uint64_t) p[7];
+}
+
+static void store_be64(unsigned char *p, uint64_t v){
+  int i;
+
+  for(i=7; i>=0; i--){
+    p[i] = (unsigned char) v;
+    v >>= 8;
+  }
+}
+
+/**
+ Copies every lane's digest into the gap a round's message leaves for it,
+ which starts shift bits into the word w, as place_digest() in
+ sha512crypt.c does for one lane.
+*/
+
+static void place_digests(lane_words *w, int shift, lane_words *h,
+                          int lanes){
+  int i, lane;
+
+  if(shift == 0){
+    memcpy(w, h, 8 * sizeof(lane_words));
+    return;
+  }
+  for(lane=0; lane<lanes; lane++){
+    w[0][lane] = (w[0][lane] & ~(~0ULL >> shift)) | h[0][lane] >> shift;
+    w[8][lane] = h[7][lane] << (64 - shift) | (w[8][lane] & ~0ULL >> shift);
+  }
+  for(i=1; i<8; i++){
+    for(lane=0; lane<lanes; lane++){
+      w[i][lane] = h[i-1][lane] << (64 - shift) | h[i][lane] >> shift;
+    }
+  }
+}
+
+#define ROR256(x, n) \
+  _mm256_or_si256(_mm256_srli_epi64((x), (n)), _mm256_slli_epi64((x), 64-(n)))
+
+__attribute__((target("avx2")))
+static void compress_avx2(lane_words *h, lane_words *block){
+  __m256i w[16];
+  __m256i a, b, c, d, e, f, g, k, t1, t2, s0, s1;
+  int t;
+
+  for(t=0; t<16; t++){
+    w[t] = _mm256_loadu_si256((__m256i *) block[t]);
+  }
+  a = _mm256_loadu_si256((__m256i *) h[0]);
+  b = _mm256_loadu_si256((__m256i *) h[1]);
+  c = _mm256_loadu_si256((__m256i *) h[2]);
+  d = _mm256_loadu_si256((__m256i *) h[3]);
+  e = _mm256_loadu_si256((__m256i *) h[4]);
+  f = _mm256_loadu_si256((__m256i *) h[5]);
+  g = _mm256_loadu_si256((__m256i *) h[6]);
+  k = _mm256_loadu_si256((__m256i *) h[7]);
+
+  for(t=0; t<80; t++){
+    if(t >= 16){
+      __m256i w15 = w[(t-15) & 15], w2 = w[(t-2) & 15];
+      s0 = _mm256_xor_si256(_mm256_xor_si256(ROR256(w15, 1), ROR256(w15, 8)),
+                            _mm256_srli_epi64(w15, 7));
+      s1 = _mm256_xor_si256(_mm256_xor_si256(ROR256(w2, 19), ROR256(w2, 61)),
+                            _mm256_srli_epi64(w2, 6));
+      w[t & 15] = _mm256_add_epi64(_mm256_add_epi64(w[t & 15], s0),
+                                   _mm256_add_epi64(w[(t-7) & 15], s1));
+    }
+    s1 = _mm256_xor_si256(_mm256_xor_si256(ROR256(e, 14), ROR256(e, 18)),
+                          ROR256(e, 41));
+    t1 = _mm256_add_epi64(_mm256_add_epi64(k, s1),
+           _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g)));
+    t1 = _mm256_add_epi64(t1, _mm256_add_epi64(
+           _mm256_set1_epi64x((long long) sha512_k[t]), w[t & 15]));
+    s0 = _mm256_xor_si256(_mm256_xor_si256(ROR256(a, 28), ROR256(a, 34)),
+                          ROR256(a, 39));
+    t2 = _mm256_add_epi64(s0, _mm256_or_si256(_mm256_and_si256(a, b),
+                            _mm256_and_si256(c, _mm256_or_si256(a, b))));
+    k = g; g = f; f = e; e = _mm256_add_epi64(d, t1);
+    d = c; c = b; b = a; a = _mm256_add_epi64(t1, t2);
+  }
+
+  _mm256_storeu_si256((__m256i *) h[0],
+    _mm256_add_epi64(a, _mm256_loadu_si256((__m256i *) h[0])));
+  _mm256_storeu_si256((__m256i *) h[1],
+    _mm256_add_epi64(b, _mm256_loadu_si256((__m256i *) h[1])));
+  _mm256_storeu_si256((__m256i *) h[2],
+    _mm256_add_epi64(c, _mm256_loadu_si256((__m256i *) h[2])));
+  _mm256_storeu_si256((__m256i *) h[3],
+    _mm256_add_epi64(d, _mm256_loadu_si256((__m256i *) h[3])));
+  _mm256_storeu_si256((__m256i *) h[4],
+    _mm256_add_epi64(e, _mm256_loadu_si256((__m256i *) h[4])));
+  _mm256_storeu_si256((__m256i *) h[5],
+    _mm256_add_epi64(f, _mm256_loadu_si256((__m256i *) h[5])));
+  _mm256_storeu_si256((__m256i *) h[6],
+    _mm256_add_epi64(g, _mm256_loadu_si256((__m256i *) h[6])));
+  _mm256_storeu_si256((__m256i *) h[7],
+    _mm256_add_epi64(k, _mm256_loadu_si256((__m256i *) h[7])));
+}
+
+// Three way XOR, choose and majority are single ternary-logic instructions
+#define XOR3_512(x, y, z) _mm512_ternarylogic_epi64((x), (y), (z), 0x96)
+#define CH_512(x, y, z)   _mm512_ternarylogic_epi64((x), (y), (z), 0xca)
+#define MAJ_512(x, y, z)  _mm512_ternarylogic_epi64((x), (y), (z), 0xe8)
+
+__attribute__((target("avx512f")))
+static void compress_avx512(lane_words *h, lane_words *block){
+  __m512i w[16];
+  __m512i v[8];
+  __m512i a, b, c, d, e, f, g, k, t1, t2;
+  int t;
+
+  for(t=0; t<16; t++){
+    w[t] = _mm512_loadu_si512(block[t]);
+  }
+  for(t=0; t<8; t++){
+    v[t] = _mm512_loadu_si512(h[t]);
+  }
+  a = v[0]; b = v[1]; c = v[2]; d = v[3];
+  e = v[4]; f = v[5]; g = v[6]; k = v[7];
+
+  for(t=0; t<80; t++){
+    if(t >= 16){
+      __m512i w15 = w[(t-15) & 15], w2 = w[(t-2) & 15];
+      __m512i s0 = XOR3_512(_mm512_ror_epi64(w15, 1), _mm512_ror_epi64(w15, 8),
+                            _mm512_srli_epi64(w15, 7));
+      __m512i s1 = XOR3_512(_mm512_ror_epi64(w2, 19), _mm512_ror_epi64(w2, 61),
+                            _mm512_srli_epi64(w2, 6));
+      w[t & 15] = _mm512_add_epi64(_mm512_add_epi64(w[t & 15], s0),
+                                   _mm512_add_epi64(w[(t-7) & 15], s1));
+    }
+    t1 = _mm512_add_epi64(k, XOR3_512(_mm512_ror_epi64(e, 14),
+                                      _mm512_ror_epi64(e, 18),
+                                      _mm512_ror_epi64(e, 41)));
+    t1 = _mm512_add_epi64(t1, CH_512(e, f, g));
+    t1 = _mm512_add_epi64(t1, _mm512_add_epi64(
+           _mm512_set1_epi64((long long) sha512_k[t]), w[t & 15]));
+    t2 = _mm512_add_epi64(XOR3_512(_mm512_ror_epi64(a, 28),
+                                   _mm512_ror_epi64(a, 34),
+                                   _mm512_ror_epi64(a, 39)), MAJ_512(a, b, c));
+    k = g; g = f; f = e; e = _mm512_add_epi64(d, t1);
+    d = c; c = b; b = a; a = _mm512_add_epi64(t1, t2);
+  }
+
+  _mm512_storeu_si512(h[0], _mm512_add_epi64(a, v[0]));
+  _mm512_storeu_si512(h[1], _mm512_add_epi64(b, v[1]));
+  _mm512_storeu_si512(h[2], _mm512_add_epi64(c, v[2]));
+  _mm512_storeu_si512(h[3], _mm512_add_epi64(d, v[3]));
+  _mm512_storeu_si512(h[4], _mm512_add_epi64(e, v[4]));
+  _mm512_storeu_si512(h[5], _mm512_add_epi64(f, v[5]));
+  _mm512_storeu_si512(h[6], _mm512_add_epi64(g, v[6]));
+  _mm512_storeu_si512(h[7], _mm512_add_epi64(k, v[7]));
+}
+
+static int supported(int engine){
+  __builtin_cpu_init();
+  switch(engine){
+    case SHA512MB_SCALAR:
+      return 1;
+    case SHA512MB_AVX2:
+      return __builtin_cpu_supports("avx2");
+    case SHA512MB_AVX512:
+      return __builtin_cpu_supports("avx512f");
+  }
+  return 0;
+}
+
+/**
+ Turns "scalar", "avx2", "avx512" or "auto" into an engine number. "auto" (or
+ NULL) picks the widest engine this CPU can run. Returns -1 for unknown names
+ and for engines the CPU does not support.
+*/
+
+int sha512mb_select(const char *name){
+  int engine;
+
+  if(name == NULL || strcmp(name, "auto") == 0){
+    for(engine=SHA512MB_AVX512; engine>SHA512MB_SCALAR; engine--){
+      if(supported(engine)){
+        break;
+      }
+    }
+    return engine;
+  }
+  for(engine=SHA512MB_SCALAR; engine<=SHA512MB_AVX512; engine++){
+    if(strcmp(name, sha512mb_name(engine)) == 0){
+      return supported(engine) ? engine : -1;
+    }
+  }
+  return -1;
+}
+
+int sha512mb_lanes(int engine){
+  switch(engine){
+    case SHA512MB_AVX2:
+      return 4;
+    case SHA512MB_AVX512:
+      return 8;
+  }
+  return 1;
+}
+
+const char *sha512mb_name(int engine){
+  switch(engine){
+    case SHA512MB_AVX2:
+      return "avx2";
+    case SHA512MB_AVX512:
+      return "avx512";
+  }
+  return "scalar";
+}
+
+/**
+ Hashes n (at most sha512mb_lanes(engine)) keys of length key_len with one
+ salt. Spare lanes repeat the first key. Returns -1 if the keys are too long.
+*/
+
+int sha512crypt_mb(int engine, const sha512crypt_salt *salt,
+                   const char *const *keys, size_t key_len, int n,
+                   unsigned char (*digests)[SHA512CRYPT_DIGEST_LEN]){
+  unsigned char p_bytes[SHA512CRYPT_KEY_MAX];
+  const unsigned char *s_bytes;
+  sha512crypt_pattern patterns[SHA512CRYPT_PATTERNS];
+  unsigned char spare[SHA512CRYPT_DIGEST_LEN];
+  unsigned char *digest[SHA512MB_LANES_MAX];
+  _Alignas(64) lane_words h[8];
+  _Alignas(64) lane_words
+    block[SHA512CRYPT_PATTERNS][SHA512CRYPT_BLOCKS_MAX * 16];
+  int lanes = sha512mb_lanes(engine);
+  unsigned long r;
+  int lane, kind, i;
+
+  if(lanes == 1){
+    for(lane=0; lane<n; lane++){
+      if(sha512crypt_raw(salt, keys[lane], key_len, digests[lane]) != 0){
+        return -1;
+      }
+    }
+    return 0;
+  }
+
+  for(lane=0; lane<lanes; lane++){
+    digest[lane] = lane < n ? digests[lane] : spare;
+    s_bytes = sha512crypt_prepare(salt, keys[lane < n ? lane : 0], key_len,
+                                  digest[lane], p_bytes);
+    if(s_bytes == NULL){
+      return -1;
+    }
+    sha512crypt_patterns(patterns, p_bytes, key_len, s_bytes,
+                         salt->salt_len);
+    for(kind=0; kind<SHA512CRYPT_PATTERNS; kind++){
+      for(i=0; i<patterns[kind].blocks * 16; i++){
+        block[kind][i][lane] = patterns[kind].words[i];
+      }
+    }
+    for(i=0; i<8; i++){
+      h[i][lane] = load_be64(digest[lane] + 8 * i);
+    }
+  }
+
+  // The layout of each kind is the same in every lane, so any lane's will do
+  for(r=0; r<salt->rounds; r++){
+    sha512crypt_pattern *pattern;
+    lane_words *message;
+    int b;
+
+    kind = sha512crypt_pattern_of(r);
+    pattern = &patterns[kind];
+    message = block[kind];
+    place_digests(message + pattern->offset / 8, 8 * (pattern->offset % 8),
+                  h, lanes);
+    for(i=0; i<8; i++){
+      for(lane=0; lane<lanes; lane++){
+        h[i][lane] = sha512_h0[i];
+      }
+    }
+    for(b=0; b<pattern->blocks; b++){
+      if(engine == SHA512MB_AVX512){
+        compress_avx512(h, message + 16 * b);
+      } else {
+        compress_avx2(h, message + 16 * b);
+      }
+    }
+  }
+  for(lane=0; lane<lanes; lane++){
+    for(i=0; i<8; i++){
+      store_be64(digest[lane] + 8 * i, h[i][lane]);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,25 @@
+#ifndef SHA512MB_H
+#define SHA512MB_H
+
+#include "sha512crypt.h"
+
+/******************************************************************************
+  Multi-buffer SHA-512-crypt. Up to SHA512MB_LANES_MAX candidates of the same
+  length share one salt and go through the round loop in lockstep, one
+  candidate per 64-bit SIMD lane: 4 lanes with AVX2, 8 with AVX-512.
+******************************************************************************/
+
+#define SHA512MB_SCALAR    0
+#define SHA512MB_AVX2      1
+#define SHA512MB_AVX512    2
+
+#define SHA512MB_LANES_MAX 8
+
+int sha512mb_select(const char *name);
+int sha512mb_lanes(int engine);
+const char *sha512mb_name(int engine);
+int sha512crypt_mb(int engine, const sha512crypt_salt *salt,
+                   const char *const *keys, size_t key_len, int n,
+                   unsigned char (*digests)[SHA512CRYPT_DIGEST_LEN]);
+
+#endif
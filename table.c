@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "table.h"
+#include "sha512mb.h"
+
+/******************************************************************************
+  Writing, mapping and searching precomputed digest tables. See table.h.
+
+  Link into a cracker with:
+    cc -O2 -o CrackAZ99-With-Data CrackAZ99-With-Data.c sha512crypt.c \
+       sha512mb.c targets.c mask.c scheme.c table.c log.c meter.c batch.c \
+       -pthread -lcrypt -lm
+******************************************************************************/
+
+/**
+ Identifies a keyspace by the characters at each position rather than by the
+ text of the mask, so "?d" and "?1" with -1 0123456789 share a table.
+*/
+
+uint64_t table_mask_id(const mask *m){
+  uint64_t h = 14695981039346656037ull;   // FNV-1a
+  int i, j;
+
+  for(i=0; i<m->length; i++){
+    h = (h ^ (unsigned) m->size[i]) * 1099511628211ull;
+    for(j=0; j<m->size[i]; j++){
+      h = (h ^ (unsigned char) m->set[i][j]) * 1099511628211ull;
+    }
+  }
+  return h;
+}
+
+static int entry_order(const void *a, const void *b){
+  const table_entry *x = a, *y = b;
+
+  if(x->prefix != y->prefix){
+    return x->prefix < y->prefix ? -1 : 1;
+  }
+  return (x->index > y->index) - (x->index < y->index);
+}
+
+/**
+ Sorts n entries and writes them out as a table for setting and m. The table
+ is written under another name and renamed into place, so an interrupted run
+ never leaves a table that looks complete. Returns 0, or -1 on failure.
+*/
+
+int table_write(const char *path, const char *setting, const mask *m,
+                table_entry *entries, uint64_t n){
+  table_header header;
+  char tmp[4096];
+  FILE *f;
+
+  if(strlen(setting) >= sizeof(header.setting)){
+    fprintf(stderr, "%s is too long a setting for a table\n", setting);
+    return -1;
+  }
+  qsort(entries, n, sizeof(table_entry), entry_order);
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, TABLE_MAGIC, 8);
+  strcpy(header.setting, setting);
+  header.mask_id = table_mask_id(m);
+  header.n_entries = n;
+
+  snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+  f = fopen(tmp, "wb");
+  if(f == NULL){
+    perror(tmp);
+    return -1;
+  }
+  if(fwrite(&header, sizeof(header), 1, f) != 1 ||
+     fwrite(entries, sizeof(table_entry), n, f) != n){
+    perror(tmp);
+    fclose(f);
+    remove(tmp);
+    return -1;
+  }
+  if(fclose(f) != 0 || rename(tmp, path) != 0){
+    perror(path);
+    remove(tmp);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ Maps the table at path. Returns 0, or -1 if it cannot be read or is not a
+ complete table.
+*/
+
+int table_open(digest_table *t, const char *path){
+  struct stat st;
+  void *map;
+  int fd = open(path, O_RDONLY);
+
+  if(fd < 0 || fstat(fd, &st) != 0){
+    perror(path);
+    if(fd >= 0){
+      close(fd);
+    }
+    return -1;
+  }
+  if((size_t) st.st_size < sizeof(table_header)){
+    fprintf(stderr, "%s is not a digest table\n", path);
+    close(fd);
+    return -1;
+  }
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(map == MAP_FAILED){
+    perror(path);
+    return -1;
+  }
+  t->header = map;
+  t->entries = (const table_entry *) (t->header + 1);
+  t->size = st.st_size;
+  if(memcmp(t->header->magic, TABLE_MAGIC, 8) != 0 ||
+     t->header->n_entries != (t->size - sizeof(table_header)) /
+                             sizeof(table_entry)){
+    fprintf(stderr, "%s is not a complete digest table\n", path);
+    munmap(map, t->size);
+    return -1;
+  }
+  // Lookups jump about the file, so read ahead is wasted
+  madvise(map, t->size, MADV_RANDOM);
+  return 0;
+}
+
+/**
+ Returns 1 if the table was made for setting and the keyspace of m.
+*/
+
+int table_covers(const digest_table *t, const char *setting, const mask *m){
+  return strcmp(t->header->setting, setting) == 0 &&
+         t->header->mask_id == table_mask_id(m) &&
+         t->header->n_entries == mask_keyspace(m);
+}
+
+/**
+ Looks for the candidate whose digest is digest, which must be for the
+ table's setting; c must be set up for that setting too. Returns 1 with its
+ number in index and the candidate in plain, which needs room for
+ MASK_MAX + 1 characters, or 0 if it is not in the keyspace.
+*/
+
+int table_lookup(const digest_table *t, const mask *m, scheme_ctx *c,
+                 int engine, const unsigned char *digest, uint64_t *index,
+                 char *plain){
+  uint64_t prefix = table_prefix(digest);
+  uint64_t lo = 0, hi = t->header->n_entries;
+
+  // The first entry with this prefix, if there is one
+  while(lo < hi){
+    uint64_t mid = lo + (hi - lo) / 2;
+    if(t->entries[mid].prefix < prefix){
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  for(; lo<t->header->n_entries && t->entries[lo].prefix==prefix; lo++){
+    unsigned char check[SHA512MB_LANES_MAX][SHA512CRYPT_DIGEST_LEN];
+    const char *keys[SHA512MB_LANES_MAX] = {0};
+    mask_iter it;
+
+    mask_seek(&it, m, t->entries[lo].index);
+    keys[0] = it.plain;
+    scheme_hash(c, engine, keys, m->length, 1, check);
+    if(sha512crypt_equal(check[0], digest)){
+      *index = t->entries[lo].index;
+      memcpy(plain, it.plain, m->length + 1);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+void table_close(digest_table *t){
+  munmap((void *) t->header, t->size);
+}
@@ -0,0 +1,62 @@
+#ifndef TABLE_H
+#define TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "mask.h"
+#include "scheme.h"
+
+/******************************************************************************
+  Precomputed digest tables. When every target uses the same salt, as the
+  course data does with $6$KB$, hashing the same keyspace again on every run
+  is wasted work. A table holds the digest of every candidate in a mask for
+  one setting, sorted, so cracking a target is a binary search.
+
+  The file is a header followed by one entry per candidate: the first 8
+  bytes of its digest and its number in the mask. Entries are sorted by
+  those 8 bytes and mapped straight from the file, so opening a table costs
+  nothing however big it is. Candidates whose prefix matches are hashed once
+  more to check the whole digest, which keeps entries at 16 bytes without
+  ever reporting a false match. Tables are in the byte order of the machine
+  that made them.
+******************************************************************************/
+
+#define TABLE_MAGIC "CRKTBL1"
+
+typedef struct {
+  char magic[8];
+  char setting[48];         // The setting every digest was made with
+  uint64_t mask_id;         // table_mask_id() of the keyspace
+  uint64_t n_entries;       // The size of the keyspace
+} table_header;
+
+typedef struct {
+  uint64_t prefix;          // The first 8 bytes of the digest
+  uint64_t index;           // The candidate's number in the mask
+} table_entry;
+
+typedef struct {
+  const table_header *header;
+  const table_entry *entries;
+  size_t size;
+} digest_table;
+
+uint64_t table_mask_id(const mask *m);
+int table_write(const char *path, const char *setting, const mask *m,
+                table_entry *entries, uint64_t n);
+int table_open(digest_table *t, const char *path);
+int table_covers(const digest_table *t, const char *setting, const mask *m);
+int table_lookup(const digest_table *t, const mask *m, scheme_ctx *c,
+                 int engine, const unsigned char *digest, uint64_t *index,
+                 char *plain);
+void table_close(digest_table *t);
+
+static inline uint64_t table_prefix(const unsigned char *digest){
+  uint64_t prefix;
+
+  memcpy(&prefix, digest, sizeof(prefix));
+  return prefix;
+}
+
+#endif
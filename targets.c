@@ -0,0 +1,407 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "targets.h"
+#include "scheme.h"
+#include "log.h"
+
+/******************************************************************************
+  Groups target hashes by salt and builds a digest lookup table per group.
+  The digests are decoded from base64 once, here, so the crackers compare raw
+  digests and a lookup costs one probe in the common case however many
+  targets share the salt.
+
+  Link into a cracker with:
+    cc -O2 -o CrackAZ99-With-Data CrackAZ99-With-Data.c sha512crypt.c \
+       sha512mb.c targets.c mask.c scheme.c table.c log.c meter.c batch.c \
+       -pthread -lcrypt -lm
+******************************************************************************/
+
+#define FIND_AHEAD 64           // Digests whose slots are prefetched at once
+
+/**
+ Digests are already uniformly distributed, so their first 8 bytes make a
+ perfectly good hash.
+*/
+
+static uint32_t digest_slot(const unsigned char *digest, uint32_t mask){
+  uint64_t h;
+
+  memcpy(&h, digest, sizeof(h));
+  return (uint32_t) (h ^ (h >> 32)) & mask;
+}
+
+static uint32_t string_hash(const char *s){
+  uint32_t h = 2166136261u;   // FNV-1a
+
+  while(*s){
+    h = (h ^ (unsigned char) *s++) * 16777619u;
+  }
+  // FNV's low bits are poor for salts that differ only at the end, and the
+  // table is indexed by them, so mix the high bits down
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  return h;
+}
+
+static uint32_t table_size(int n){
+  uint32_t size = 4;
+
+  while(size < 2u * (uint32_t) n){
+    size <<= 1;
+  }
+  return size;
+}
+
+/**
+ The state needed while targets are being added to a set.
+*/
+
+typedef struct {
+  uint32_t *index;          // Open addressing, group number + 1, 0 is empty
+  uint32_t mask;            // Index size - 1
+} loader;
+
+/**
+ Finds the group for a setting, adding one if this is a new salt.
+*/
+
+static int group_for(target_set *set, loader *l, const char *setting,
+                     int scheme){
+  uint32_t slot = string_hash(setting) & l->mask;
+  salt_group *g;
+
+  while(l->index[slot] != 0){
+    if(strcmp(set->groups[l->index[slot] - 1].setting, setting) == 0){
+      return l->index[slot] - 1;
+    }
+    slot = (slot + 1) & l->mask;
+  }
+
+  g = &set->groups[set->n_groups];
+  strcpy(g->setting, setting);
+  g->scheme = scheme;
+  g->n_targets = 0;
+  l->index[slot] = ++set->n_groups;
+  return set->n_groups - 1;
+}
+
+/**
+ Makes room for up to n targets.
+*/
+
+static void load_begin(target_set *set, loader *l, int n){
+  l->mask = table_size(n) - 1;
+  l->index = calloc(l->mask + 1, sizeof(uint32_t));
+
+  set->targets = malloc((n > 0 ? n : 1) * sizeof(target));
+  set->n_targets = 0;
+  // Room for a salt per target. Pages that are never used are never touched,
+  // so this costs nothing when they share a few salts.
+  set->groups = malloc((n > 0 ? n : 1) * sizeof(salt_group));
+  set->n_groups = 0;
+  set->map = NULL;
+  set->map_size = 0;
+}
+
+/**
+ Parses a hash of len characters and adds it to its salt's group. The hash
+ need not be terminated and is not copied, so it must outlive the set.
+ Returns 0, or -1 if it is not a hash in a scheme we support.
+*/
+
+static int add_target(target_set *set, loader *l, const char *hash,
+                      size_t len){
+  target *t = &set->targets[set->n_targets];
+  char text[SHA512CRYPT_HASH_MAX];
+  int setting_len, scheme;
+
+  if(len >= SHA512CRYPT_HASH_MAX){
+    return -1;
+  }
+  memcpy(text, hash, len);
+  text[len] = '\0';
+  setting_len = scheme_split(text, &scheme, t->digest);
+  if(setting_len < 0){
+    return -1;
+  }
+  text[setting_len] = '\0';
+  t->hash = hash;
+  t->hash_len = (int) len;
+  t->next = -1;
+  atomic_init(&t->found, 0);
+  t->found_at = 0;
+  t->group = group_for(set, l, text, scheme);
+  set->groups[t->group].n_targets++;
+  set->n_targets++;
+  return 0;
+}
+
+/**
+ Lays out the lookup tables once every target has been added.
+*/
+
+static void load_finish(target_set *set, loader *l){
+  size_t offset;
+  int i, g;
+
+  free(l->index);
+
+  offset = 0;
+  for(g=0; g<set->n_groups; g++){
+    offset += table_size(set->groups[g].n_targets);
+  }
+  set->tables = calloc(offset > 0 ? offset : 1, sizeof(uint32_t));
+  offset = 0;
+  for(g=0; g<set->n_groups; g++){
+    salt_group *group = &set->groups[g];
+    group->table = set->tables + offset;
+    group->mask = table_size(group->n_targets) - 1;
+    atomic_init(&group->remaining, group->n_targets);
+    offset += group->mask + 1;
+  }
+  atomic_init(&set->remaining, set->n_targets);
+
+  for(i=0; i<set->n_targets; i++){
+    target *t = &set->targets[i];
+    salt_group *group = &set->groups[t->group];
+    uint32_t slot = digest_slot(t->digest, group->mask);
+
+    while(group->table[slot] != 0){
+      target *other = &set->targets[group->table[slot] - 1];
+      if(memcmp(other->digest, t->digest, SHA512CRYPT_DIGEST_LEN) == 0){
+        // Same hash listed twice: chain it so both get reported
+        while(other->next >= 0){
+          other = &set->targets[other->next];
+        }
+        other->next = i;
+        break;
+      }
+      slot = (slot + 1) & group->mask;
+    }
+    if(group->table[slot] == 0){
+      group->table[slot] = i + 1;
+    }
+  }
+}
+
+/**
+ Parses n hashes and groups them by salt. Hashes that cannot be parsed are
+ reported and left out. The strings are not copied, so they must outlive the
+ set. Returns the number of targets loaded.
+*/
+
+int targets_load(target_set *set, char **hashes, int n){
+  loader l;
+  int i;
+
+  load_begin(set, &l, n);
+  for(i=0; i<n; i++){
+    if(add_target(set, &l, hashes[i], strlen(hashes[i])) != 0){
+      fprintf(stderr, "Skipping %s: not a supported hash\n", hashes[i]);
+    }
+  }
+  load_finish(set, &l);
+  return set->n_targets;
+}
+
+/**
+ Loads the hashes in a file, which may hold one hash per line or be in the
+ format of /etc/shadow, where the hash is the second field. Blank lines and
+ accounts that are locked or have no password are passed over quietly. The
+ file is mapped rather than read and the targets point straight into it, so
+ nothing is allocated per line and the set holds the mapping until it is
+ freed. Returns the number of targets loaded, or -1 if the file could not be
+ read.
+*/
+
+int targets_load_file(target_set *set, const char *path){
+  struct stat st;
+  const char *map = NULL, *p, *end, *line_end;
+  long n_lines = 1, skipped = 0;
+  loader l;
+  int fd;
+
+  fd = open(path, O_RDONLY);
+  if(fd < 0 || fstat(fd, &st) != 0){
+    perror(path);
+    if(fd >= 0){
+      close(fd);
+    }
+    return -1;
+  }
+  if(st.st_size > 0){
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(map == MAP_FAILED){
+      perror(path);
+      close(fd);
+      return -1;
+    }
+    madvise((void *) map, st.st_size, MADV_SEQUENTIAL);
+  }
+  close(fd);
+  end = map + st.st_size;
+
+  // Counting the lines first means the targets are one allocation
+  for(p=map; p<end && (p = memchr(p, '\n', end - p)) != NULL; p++){
+    n_lines++;
+  }
+  if(n_lines > INT_MAX / 2){
+    fprintf(stderr, "%s has too many lines\n", path);
+    munmap((void *) map, st.st_size);
+    return -1;
+  }
+
+  load_begin(set, &l, (int) n_lines);
+  for(p=map; p<end; p=line_end+1){
+    const char *hash = p, *colon;
+    size_t len;
+
+    line_end = memchr(p, '\n', end - p);
+    if(line_end == NULL){
+      line_end = end;
+    }
+    len = line_end - p;
+    if(len > 0 && hash[len - 1] == '\r'){
+      len--;
+    }
+    colon = memchr(hash, ':', len);
+    if(colon != NULL){
+      // user:hash:... as in /etc/shadow
+      len -= colon + 1 - hash;
+      hash = colon + 1;
+      colon = memchr(hash, ':', len);
+      if(colon != NULL){
+        len = colon - hash;
+      }
+    }
+    if(len == 0 || hash[0] != '$'){
+      continue;
+    }
+    if(add_target(set, &l, hash, len) != 0){
+      skipped++;
+    }
+  }
+  load_finish(set, &l);
+  set->map = (void *) map;
+  set->map_size = st.st_size;
+
+  if(skipped > 0){
+    fprintf(stderr, "Skipped %ld hashes in %s that are not supported\n",
+            skipped, path);
+  }
+  return set->n_targets;
+}
+
+/**
+ Returns the index of the first target in the group with this digest, or -1.
+ Further targets with the same hash are linked through target.next.
+*/
+
+int targets_find(const target_set *set, int group,
+                 const unsigned char *digest){
+  const salt_group *g = &set->groups[group];
+  uint32_t slot = digest_slot(digest, g->mask);
+
+  while(g->table[slot] != 0){
+    const target *t = &set->targets[g->table[slot] - 1];
+    if(sha512crypt_equal(t->digest, digest)){
+      return g->table[slot] - 1;
+    }
+    slot = (slot + 1) & g->mask;
+  }
+  return -1;
+}
+
+/**
+ targets_find() for n digests at once, with the index of each one's target,
+ or -1, put in found. The table slots of a run of digests are worked out and
+ prefetched before any of them is probed, so that with a table too big for
+ the cache the misses overlap rather than coming one after another. Returns
+ how many of the digests were found.
+*/
+
+int targets_find_batch(const target_set *set, int group,
+                       const unsigned char (*digests)[SHA512CRYPT_DIGEST_LEN],
+                       int n, int *found){
+  const salt_group *g = &set->groups[group];
+  uint32_t slot[FIND_AHEAD];
+  int i, j, hits = 0;
+
+  for(i=0; i<n; i+=FIND_AHEAD){
+    int run = n - i < FIND_AHEAD ? n - i : FIND_AHEAD;
+
+    for(j=0; j<run; j++){
+      slot[j] = digest_slot(digests[i + j], g->mask);
+      __builtin_prefetch(&g->table[slot[j]]);
+    }
+    for(j=0; j<run; j++){
+      found[i + j] = -1;
+      while(g->table[slot[j]] != 0){
+        const target *t = &set->targets[g->table[slot[j]] - 1];
+        if(sha512crypt_equal(t->digest, digests[i + j])){
+          found[i + j] = g->table[slot[j]] - 1;
+          hits++;
+          break;
+        }
+        slot[j] = (slot[j] + 1) & g->mask;
+      }
+    }
+  }
+  return hits;
+}
+
+/**
+ Records that target t fell to candidate number index. Only the first caller
+ for a target gets 1 back, so only one thread reports it however many find
+ it at once; everybody else gets 0.
+*/
+
+int targets_crack(target_set *set, int t, uint64_t index){
+  target *tgt = &set->targets[t];
+  int expected = 0;
+
+  if(!atomic_compare_exchange_strong(&tgt->found, &expected, 1)){
+    return 0;
+  }
+  tgt->found_at = index;
+  atomic_fetch_sub(&set->groups[tgt->group].remaining, 1);
+  atomic_fetch_sub(&set->remaining, 1);
+  return 1;
+}
+
+/**
+ Displays each target with the number of the candidate that cracked it,
+ counting from 1 as the original programs did.
+*/
+
+void targets_summary(target_set *set){
+  int i;
+
+  for(i=0; i<set->n_targets; i++){
+    target *t = &set->targets[i];
+    if(atomic_load(&t->found)){
+      log_printf(LOG_INFO, "%.*s cracked by candidate %llu", t->hash_len,
+                 t->hash, (unsigned long long) t->found_at + 1);
+    } else {
+      log_printf(LOG_INFO, "%.*s not found", t->hash_len, t->hash);
+    }
+  }
+  log_printf(LOG_INFO, "%d of %d targets cracked",
+             set->n_targets - targets_remaining(set), set->n_targets);
+}
+
+void targets_free(target_set *set){
+  free(set->targets);
+  free(set->groups);
+  free(set->tables);
+  if(set->map != NULL){
+    munmap(set->map, set->map_size);
+  }
+}
@@ -0,0 +1,74 @@
+#ifndef TARGETS_H
+#define TARGETS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include "sha512crypt.h"
+
+/******************************************************************************
+  The hashes a cracker is looking for, grouped by salt. Every candidate only
+  has to be hashed once per distinct salt: the digest is then looked up in
+  the group's table, which holds every target that uses that salt. A salt
+  belongs to one hash scheme, so the groups also keep the schemes apart.
+
+  The set also counts the targets that are still to be found, overall and
+  per group, so workers can give up on a salt, or on the whole run, as soon
+  as there is nothing left for them to find.
+******************************************************************************/
+
+typedef struct {
+  const char *hash;         // The hash as it was given to us, not terminated
+  int hash_len;             // when it came from a file, so print with %.*s
+  unsigned char digest[SHA512CRYPT_DIGEST_LEN];
+  int group;                // Index into target_set.groups
+  int next;                 // Next target with an identical hash, or -1
+  _Atomic int found;        // Set once by whoever cracks it
+  uint64_t found_at;        // The candidate number that cracked it
+} target;
+
+typedef struct {
+  char setting[SHA512CRYPT_SETTING_MAX];
+  int scheme;               // SCHEME_ in scheme.h
+  int n_targets;
+  uint32_t *table;          // Open addressing, target index + 1, 0 is empty
+  uint32_t mask;            // Table size - 1
+  _Atomic int remaining;    // Targets in the group still to be found
+} salt_group;
+
+typedef struct {
+  target *targets;
+  int n_targets;
+  salt_group *groups;
+  int n_groups;
+  uint32_t *tables;         // One allocation shared by every group's table
+  _Atomic int remaining;    // Targets still to be found
+  void *map;                // The hash file the targets point into, if any
+  size_t map_size;
+} target_set;
+
+int targets_load(target_set *set, char **hashes, int n);
+int targets_load_file(target_set *set, const char *path);
+int targets_find(const target_set *set, int group,
+                 const unsigned char *digest);
+int targets_find_batch(const target_set *set, int group,
+                       const unsigned char (*digests)[SHA512CRYPT_DIGEST_LEN],
+                       int n, int *found);
+int targets_crack(target_set *set, int t, uint64_t index);
+void targets_summary(target_set *set);
+void targets_free(target_set *set);
+
+/**
+ Cheap enough to call once per chunk: a relaxed read of a shared counter.
+*/
+
+static inline int targets_remaining(target_set *set){
+  return atomic_load_explicit(&set->remaining, memory_order_relaxed);
+}
+
+static inline int group_remaining(target_set *set, int group){
+  return atomic_load_explicit(&set->groups[group].remaining,
+                              memory_order_relaxed);
+}
+
+#endif
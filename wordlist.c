@@ -0,0 +1,305 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "wordlist.h"
+
+/******************************************************************************
+  Mapping wordlists and compiling and applying mangling rules. See
+  wordlist.h for the rule language.
+
+  Link into a cracker with:
+    cc -O2 -o Threadcw Threadcw.c sha512crypt.c sha512mb.c targets.c pool.c \
+       mask.c checkpoint.c wordlist.c scheme.c markov.c log.c meter.c \
+       affinity.c batch.c -pthread -lcrypt -lm
+******************************************************************************/
+
+/**
+ The rules used when none are given: the word itself, common changes of
+ case, digits and punctuation on the end, and leetspeak.
+*/
+
+static const char *default_rules[] = {
+  ":", "l", "u", "c", "t", "r", "d",
+  "$1", "$!", "$1 $2 $3", "c $1", "c $!", "c $1 $2 $3",
+  "$2 $0 $2 $6", "c $2 $0 $2 $6", "^1",
+  "sa4 se3 si1 so0", "sa@ se3 si1 so0 ss$", "c sa4 se3 si1 so0",
+  "c sa@ se3 si1 so0 $1"
+};
+
+/**
+ Maps the wordlist at path. Returns 0, or -1 if it cannot be read.
+*/
+
+int wordlist_open(wordlist *w, const char *path){
+  struct stat st;
+  int fd = open(path, O_RDONLY);
+
+  if(fd < 0 || fstat(fd, &st) != 0){
+    perror(path);
+    if(fd >= 0){
+      close(fd);
+    }
+    return -1;
+  }
+  w->map = NULL;
+  w->size = st.st_size;
+  if(w->size > 0){
+    w->map = mmap(NULL, w->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(w->map == MAP_FAILED){
+      perror(path);
+      close(fd);
+      return -1;
+    }
+    madvise((void *) w->map, w->size, MADV_SEQUENTIAL);
+  }
+  close(fd);
+  return 0;
+}
+
+void wordlist_close(wordlist *w){
+  if(w->map != NULL){
+    munmap((void *) w->map, w->size);
+  }
+}
+
+/**
+ Finds the words that start between byte offsets begin and end, so that a
+ wordlist can be split into pieces of roughly equal size without an index:
+ every word belongs to exactly one piece. Returns the first of them, and
+ last is set to where the word after them starts.
+*/
+
+const char *wordlist_range(const wordlist *w, size_t begin, size_t end,
+                           const char **last){
+  const char *first, *stop;
+
+  if(end > w->size){
+    end = w->size;
+  }
+  if(begin >= end){
+    *last = w->map + end;
+    return *last;
+  }
+  first = w->map + begin;
+  if(begin > 0 && first[-1] != '\n'){
+    first = memchr(first, '\n', w->size - begin);
+    first = first ? first + 1 : w->map + w->size;
+  }
+  stop = w->map + end;
+  if(stop[-1] != '\n'){
+    stop = memchr(stop, '\n', w->size - end);
+    stop = stop ? stop + 1 : w->map + w->size;
+  }
+  *last = stop > first ? stop : first;
+  return first;
+}
+
+/**
+ Positions in rules are 0 to 9 and then A to Z.
+*/
+
+static int position(char c){
+  if(c >= '0' && c <= '9'){
+    return c - '0';
+  } else if(c >= 'A' && c <= 'Z'){
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+/**
+ Compiles the len characters of text into r. Returns 0, or -1 if the rule
+ uses an operation that is not supported or is missing an argument.
+*/
+
+int rule_compile(rule *r, const char *text, size_t len){
+  size_t i = 0;
+
+  r->n_ops = 0;
+  while(i < len){
+    rule_op *op = &r->ops[r->n_ops];
+    int args;
+
+    if(text[i] == ' ' || text[i] == '\t'){
+      i++;
+      continue;
+    }
+    op->op = text[i++];
+    switch(op->op){
+      case ':':
+        continue;
+      case 'l': case 'u': case 'c': case 'C': case 't': case 'r': case 'd':
+      case '[': case ']':
+        args = 0;
+        break;
+      case 'T': case '$': case '^':
+        args = 1;
+        break;
+      case 's':
+        args = 2;
+        break;
+      default:
+        return -1;
+    }
+    if(r->n_ops == RULE_MAX || i + args > len){
+      return -1;
+    }
+    op->a = args > 0 ? text[i] : 0;
+    op->b = args > 1 ? text[i + 1] : 0;
+    if(op->op == 'T' && position(op->a) < 0){
+      return -1;
+    }
+    i += args;
+    r->n_ops++;
+  }
+  return 0;
+}
+
+/**
+ Compiles a file of rules, one per line. Blank lines and lines starting with
+ # are passed over, and rules that cannot be compiled are reported and left
+ out. Returns the number of rules, or -1 if the file cannot be read.
+*/
+
+int rules_load(rule **rules, const char *path){
+  wordlist w;
+  const char *p, *end, *text;
+  int len, line = 0, n = 0, capacity = 16;
+
+  if(wordlist_open(&w, path) != 0){
+    return -1;
+  }
+  *rules = malloc(capacity * sizeof(rule));
+  end = w.map + w.size;
+  for(p=w.map; p<end; ){
+    p = wordlist_next(&w, p, &text, &len);
+    line++;
+    if(len <= 0 || text[0] == '#'){
+      continue;
+    }
+    if(n == capacity){
+      capacity *= 2;
+      *rules = realloc(*rules, capacity * sizeof(rule));
+    }
+    if(rule_compile(&(*rules)[n], text, len) != 0){
+      fprintf(stderr, "Skipping rule on line %d of %s: %.*s\n", line, path,
+              len, text);
+      continue;
+    }
+    n++;
+  }
+  wordlist_close(&w);
+  return n;
+}
+
+int rules_default(rule **rules){
+  int i, n = sizeof(default_rules) / sizeof(default_rules[0]);
+
+  *rules = malloc(n * sizeof(rule));
+  for(i=0; i<n; i++){
+    rule_compile(&(*rules)[i], default_rules[i], strlen(default_rules[i]));
+  }
+  return n;
+}
+
+/**
+ Applies r to a word of len characters, writing the result to out, which
+ must have room for WORD_MAX + 1 characters. Returns the length of the
+ result, or -1 if it would be empty or longer than WORD_MAX.
+*/
+
+int rule_apply(const rule *r, const char *word, int len, char *out){
+  int i, j;
+
+  if(len > WORD_MAX){
+    return -1;
+  }
+  memcpy(out, word, len);
+  for(i=0; i<r->n_ops; i++){
+    const rule_op *op = &r->ops[i];
+
+    switch(op->op){
+      case 'l':
+        for(j=0; j<len; j++){
+          out[j] = tolower((unsigned char) out[j]);
+        }
+        break;
+      case 'u':
+        for(j=0; j<len; j++){
+          out[j] = toupper((unsigned char) out[j]);
+        }
+        break;
+      case 'c': case 'C':
+        for(j=0; j<len; j++){
+          int upper = (j == 0) == (op->op == 'c');
+          out[j] = upper ? toupper((unsigned char) out[j]) :
+                           tolower((unsigned char) out[j]);
+        }
+        break;
+      case 't':
+        for(j=0; j<len; j++){
+          unsigned char c = out[j];
+          out[j] = isupper(c) ? tolower(c) : toupper(c);
+        }
+        break;
+      case 'T':
+        j = position(op->a);
+        if(j < len){
+          unsigned char c = out[j];
+          out[j] = isupper(c) ? tolower(c) : toupper(c);
+        }
+        break;
+      case 'r':
+        for(j=0; j<len/2; j++){
+          char c = out[j];
+          out[j] = out[len - 1 - j];
+          out[len - 1 - j] = c;
+        }
+        break;
+      case 'd':
+        if(2 * len > WORD_MAX){
+          return -1;
+        }
+        memcpy(out + len, out, len);
+        len *= 2;
+        break;
+      case '[':
+        if(len > 0){
+          memmove(out, out + 1, --len);
+        }
+        break;
+      case ']':
+        if(len > 0){
+          len--;
+        }
+        break;
+      case '$':
+        if(len == WORD_MAX){
+          return -1;
+        }
+        out[len++] = op->a;
+        break;
+      case '^':
+        if(len == WORD_MAX){
+          return -1;
+        }
+        memmove(out + 1, out, len++);
+        out[0] = op->a;
+        break;
+      case 's':
+        for(j=0; j<len; j++){
+          if(out[j] == op->a){
+            out[j] = op->b;
+          }
+        }
+        break;
+    }
+  }
+  out[len] = '\0';
+  return len > 0 ? len : -1;
+}
@@ -0,0 +1,74 @@
+#ifndef WORDLIST_H
+#define WORDLIST_H
+
+#include <stddef.h>
+#include <string.h>
+
+/******************************************************************************
+  Dictionary attacks. A wordlist is a file of candidate passwords, one per
+  line, that is mapped rather than read, so that words are used where they
+  lie without being copied. Each word is put through a list of mangling rules
+  before it is tried. Rules are written as in hashcat and John the Ripper, one
+  operation after another:
+
+    :    leave the word as it is      r    reverse it
+    l    lowercase it                 d    duplicate it
+    u    uppercase it                 [    delete the first character
+    c    capitalise it                ]    delete the last character
+    C    the opposite of c            $X   append X
+    t    toggle the case of it all    ^X   prepend X
+    TN   toggle the case at N         sXY  replace every X with Y
+
+  N is 0 to 9 or A to Z for 10 to 35. Leetspeak is a chain of substitutions,
+  such as "sa4 se3 so0". Spaces between operations are ignored.
+******************************************************************************/
+
+#define WORD_MAX    64          // Longest candidate, before or after mangling
+#define RULE_MAX    32          // Operations in one rule
+
+typedef struct {
+  char op;
+  char a, b;                    // Arguments, for the operations that take any
+} rule_op;
+
+typedef struct {
+  int n_ops;
+  rule_op ops[RULE_MAX];
+} rule;
+
+typedef struct {
+  const char *map;
+  size_t size;
+} wordlist;
+
+int wordlist_open(wordlist *w, const char *path);
+void wordlist_close(wordlist *w);
+const char *wordlist_range(const wordlist *w, size_t begin, size_t end,
+                           const char **last);
+
+int rule_compile(rule *r, const char *text, size_t len);
+int rules_load(rule **rules, const char *path);
+int rules_default(rule **rules);
+int rule_apply(const rule *r, const char *word, int len, char *out);
+
+/**
+ Finds the word that starts at p, which must be before the end of the file.
+ Returns where the next word starts. len is -1 for a word that is longer
+ than WORD_MAX. Carriage returns are dropped so that DOS wordlists work.
+*/
+
+static inline const char *wordlist_next(const wordlist *w, const char *p,
+                                        const char **word, int *len){
+  const char *end = w->map + w->size;
+  const char *nl = memchr(p, '\n', end - p);
+  const char *stop = nl ? nl : end;
+
+  *word = p;
+  if(stop > p && stop[-1] == '\r'){
+    stop--;
+  }
+  *len = stop - p > WORD_MAX ? -1 : (int) (stop - p);
+  return nl ? nl + 1 : end;
+}
+
+#endif